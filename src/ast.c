@@ -8,7 +8,7 @@ AstNode* astnode_alloc(AstNodeKind kind, Span span) {
     astnode->span = span;
     astnode->short_span = span;
     astnode->typespec = NULL;
-    astnode->llvmvalue = NULL;
+    astnode->query = QUERY_PENDING;
     return astnode;
 }
 
@@ -94,6 +94,7 @@ AstNode* astnode_field_new(Token* key, AstNode* value, usize idx) {
     astnode->field.key = key;
     astnode->field.value = value;
     astnode->field.idx = idx;
+    astnode->field.offset = 0;
     return astnode;
 }
 
@@ -103,6 +104,7 @@ AstNode* astnode_field_in_literal_new(Token* start, Token* key, AstNode* value)
         span_from_two(start->span, value->span));
     astnode->field.key = key;
     astnode->field.value = value;
+    astnode->field.offset = 0;
     return astnode;
 }
 
@@ -267,7 +269,6 @@ AstNode* astnode_break_new(Token* keyword, AstNode* child) {
         span_from_two(keyword->span, child ? child->span : keyword->span));
     astnode->brk.child = child;
     astnode->brk.loopref = NULL;
-    astnode->brk.llvmbb = NULL;
     return astnode;
 }
 
@@ -454,6 +455,7 @@ AstNode* astnode_function_def_new(Token* export, AstNode* header, AstNode* body)
     astnode->funcdef.body = body;
     astnode->funcdef.export = export ? true : false;
     astnode->funcdef.locals = NULL;
+    astnode->funcdef.returns = NULL;
     return astnode;
 }
 
@@ -485,6 +487,7 @@ AstNode* astnode_variable_decl_new(
     astnode->vard.initializer = initializer;
     astnode->vard.immutable = immutable;
     astnode->vard.stack = stack;
+    astnode->vard.addr_taken = false;
     return astnode;
 }
 
@@ -5,7 +5,6 @@
 #include "token.h"
 #include "type.h"
 
-#include <llvm-c/Core.h>
 
 typedef struct AstNode AstNode;
 struct Typespec;
@@ -53,6 +52,8 @@ typedef struct {
     Token* key;
     AstNode* value;
     usize idx;
+    // Byte offset, set by the struct's layout.
+    u64 offset;
 } AstNodeField;
 
 typedef struct {
@@ -161,7 +162,6 @@ typedef struct {
 typedef struct {
     AstNode* child;
     AstNode* loopref;
-    LLVMBasicBlockRef llvmbb;
 } AstNodeBreak;
 
 typedef struct {
@@ -308,6 +308,7 @@ typedef struct {
     bool export;
 
     AstNode** locals;
+    AstNode** returns;
 } AstNodeFunctionDef;
 
 typedef struct {
@@ -326,6 +327,10 @@ typedef struct {
 
     bool stack;
     bool immutable;
+    // Set by sema when `&` is applied to the variable or a part of it.
+    bool addr_taken;
+    // Only for locals: index into the function's `locals`.
+    usize idx;
 } AstNodeVariableDecl;
 
 typedef struct {
@@ -339,6 +344,8 @@ typedef struct {
     Token* identifier;
     char* name;
     AstNode* typespec;
+    // Index into the function header's `params`.
+    usize idx;
 } AstNodeParamDecl;
 
 typedef enum {
@@ -353,7 +360,6 @@ typedef struct {
     char* mangled_name;
     AstNode** fields;
     bool packed;
-    LLVMTypeRef llvmtype;
     // Used for checking aggregate dependencies.
     AstNode** deps_on;
     CycleColor color;
@@ -411,13 +417,20 @@ typedef enum {
     ASTNODE_STRUCT,
 } AstNodeKind;
 
+// State of the sema query resolving a top-level declaration.
+typedef enum {
+    QUERY_PENDING,
+    QUERY_RUNNING,
+    QUERY_DONE,
+    QUERY_FAILED,
+} QueryState;
+
 struct AstNode {
     AstNodeKind kind;
     Span span;
     Span short_span;
     Typespec* typespec;
-
-    LLVMValueRef llvmvalue;
+    QueryState query;
 
     union {
         AstNodeTypespecFunc typefunc;
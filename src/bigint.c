@@ -5,7 +5,10 @@
 // the fantastic 983/Num bigint library. Thanks 983!
 // Source: https://github.com/983/Num
 
-#define WORD_HALF_MASK 0x00000000ffffffff
+#define BIGINT_KARATSUBA_THRESHOLD 32
+// Sizes above which radix conversion divides and conquers.
+#define BIGINT_RADIX_DC_DIGITS 1000
+#define BIGINT_RADIX_DC_WORDS 48
 
 bigint BIGINT_ZERO;
 
@@ -13,64 +16,120 @@ void init_bigint() {
     BIGINT_ZERO = bigint_new_u64(0);
 }
 
+static inline u64* bigint_words(bigint* a) {
+    return a->heap ? a->heap : a->inl;
+}
+
+static inline const u64* bigint_cwords(const bigint* a) {
+    return a->heap ? a->heap : a->inl;
+}
+
+// Grows (with zeroed words) or shrinks the magnitude to `n` words.
+static void bigint_resize(bigint* a, usize n) {
+    if (n > BIGINT_INLINE_WORDS && !a->heap) {
+        buffit(a->heap, n);
+        memcpy(a->heap, a->inl, a->len * sizeof(u64));
+    } else if (a->heap) {
+        buffit(a->heap, n);
+    }
+    u64* d = bigint_words(a);
+    for (usize i = a->len; i < n; i++) d[i] = 0;
+    a->len = n;
+}
+
+static void bigint_push(bigint* a, u64 word) {
+    bigint_resize(a, a->len+1);
+    bigint_words(a)[a->len-1] = word;
+}
+
+static void bigint_set_u128(bigint* a, u128 num) {
+    a->len = 0;
+    bigint_resize(a, 2);
+    u64* d = bigint_words(a);
+    d[0] = (u64)num;
+    d[1] = (u64)(num >> 64);
+    bigint_normalize(a);
+}
+
+static bool bigint_fits_u128(const bigint* a) {
+    return a->len <= 2;
+}
+
+static u128 bigint_get_u128(const bigint* a) {
+    const u64* d = bigint_cwords(a);
+    u128 num = 0;
+    if (a->len > 1) num = (u128)d[1] << 64;
+    if (a->len > 0) num |= d[0];
+    return num;
+}
+
 bigint bigint_new() {
     bigint b;
-    b.d = NULL;
+    b.heap = NULL;
+    b.len = 0;
     b.neg = false;
     return b;
 }
 
 bigint bigint_new_u64(u64 num) {
     bigint b = bigint_new();
-    bufpush(b.d, num);
+    bigint_push(&b, num);
     bigint_normalize(&b);
     return b;
 }
 
 void bigint_clear(bigint* a) {
-    bufclear(a->d);
+    a->len = 0;
     a->neg = false;
 }
 
 void bigint_normalize(bigint* a) {
-    while (buflen(a->d) > 0 && *buflast(a->d) == 0) {
-        bufpop(a->d);
+    const u64* d = bigint_words(a);
+    while (a->len > 0 && d[a->len-1] == 0) {
+        a->len--;
     }
-    if (buflen(a->d) == 0) a->neg = false;
+    if (a->len == 0) a->neg = false;
 }
 
 void bigint_set_u64(bigint* a, u64 num) {
     bigint_clear(a);
-    bufpush(a->d, num);
+    bigint_push(a, num);
     bigint_normalize(a);
 }
 
 usize bigint_bitlength(const bigint* a) {
-    if (buflen(a->d) == 0) return 0;
-    usize msw_idx = buflen(a->d)-1;
-    return u64_bitlength(a->d[msw_idx]) + msw_idx*U64_BITS;
+    if (a->len == 0) return 0;
+    usize msw_idx = a->len-1;
+    return u64_bitlength(bigint_cwords(a)[msw_idx]) + msw_idx*U64_BITS;
+}
+
+u64 bigint_low_u64(const bigint* a) {
+    return a->len != 0 ? bigint_cwords(a)[0] : 0;
 }
 
 void bigint_copy(bigint* dest, const bigint* src) {
+    if (dest == src) return;
     bigint_clear(dest);
-    bufloop(src->d, i) {
-        bufpush(dest->d, src->d[i]);
-    }
+    bigint_resize(dest, src->len);
+    memcpy(bigint_words(dest), bigint_cwords(src), src->len * sizeof(u64));
     dest->neg = src->neg;
     bigint_normalize(dest);
 }
 
 void bigint_free(bigint* a) {
-    buffree(a->d);
+    buffree(a->heap);
+    a->len = 0;
 }
 
 int bigint_cmp_abs(const bigint* a, const bigint* b) {
-    usize na = buflen(a->d);
-    usize nb = buflen(b->d);
+    usize na = a->len;
+    usize nb = b->len;
     if (na == nb) {
+        const u64* ad = bigint_cwords(a);
+        const u64* bd = bigint_cwords(b);
         for (usize i = na; i --> 0;) {
-            if (a->d[i] != b->d[i]) {
-                return a->d[i] > b->d[i] ? 1 : -1;
+            if (ad[i] != bd[i]) {
+                return ad[i] > bd[i] ? 1 : -1;
             }
         }
         return 0;
@@ -80,7 +139,7 @@ int bigint_cmp_abs(const bigint* a, const bigint* b) {
 }
 
 int bigint_cmp(const bigint* a, const bigint* b) {
-    if (buflen(a->d) == 0 && buflen(b->d) == 0) return 0;
+    if (a->len == 0 && b->len == 0) return 0;
     else if (!a->neg && !b->neg) return  bigint_cmp_abs(a, b);
     else if ( a->neg &&  b->neg) return -bigint_cmp_abs(a, b);
     else return !a->neg && b->neg ? 1 : -1;
@@ -103,33 +162,37 @@ static u64 sub_wcarry(u64* a, u64 b) {
 
 // Only "adds" two bigints (doesn't take into account the `neg` flag).
 void bigint_add_unsigned(bigint* a, const bigint* b) {
-    usize na = buflen(a->d);
-    usize nb = buflen(b->d);
+    usize na = a->len;
+    usize nb = b->len;
     usize n = MAX(na, nb);
-    while (buflen(a->d) != n) bufpush(a->d, 0);
+    bigint_resize(a, n);
+    u64* ad = bigint_words(a);
+    const u64* bd = bigint_cwords(b);
     u64 carry = 0;
 
     usize i;
     for (i = 0; i < nb; i++) {
-        carry =  add_wcarry(&a->d[i], carry);
-        carry += add_wcarry(&a->d[i], b->d[i]);
+        carry =  add_wcarry(&ad[i], carry);
+        carry += add_wcarry(&ad[i], bd[i]);
     }
-    for (; i < na && carry; i++) {
-        carry = add_wcarry(&a->d[i], carry);
+    for (; i < n && carry; i++) {
+        carry = add_wcarry(&ad[i], carry);
     }
-    if (carry) bufpush(a->d, carry);
+    if (carry) bigint_push(a, carry);
     bigint_normalize(a);
 }
 
 void bigint_sub_unsigned(bigint* a, const bigint* b) {
+    u64* ad = bigint_words(a);
+    const u64* bd = bigint_cwords(b);
     u64 carry = 0;
     usize i;
-    for (i = 0; i < buflen(b->d); i++) {
-        carry =  sub_wcarry(&a->d[i], carry);
-        carry += sub_wcarry(&a->d[i], b->d[i]);
+    for (i = 0; i < b->len; i++) {
+        carry =  sub_wcarry(&ad[i], carry);
+        carry += sub_wcarry(&ad[i], bd[i]);
     }
-    for (; i < buflen(a->d) && carry; i++) {
-        carry = sub_wcarry(&a->d[i], carry);
+    for (; i < a->len && carry; i++) {
+        carry = sub_wcarry(&ad[i], carry);
     }
     bigint_normalize(a);
 }
@@ -159,16 +222,17 @@ void bigint_sub(bigint* a, const bigint* b) {
 }
 
 void bigint_shl(bigint* a) {
+    u64* d = bigint_words(a);
     u64 carry = 0;
-    bufloop(a->d, i) {
-        u64 word = a->d[i];
+    for (usize i = 0; i < a->len; i++) {
+        u64 word = d[i];
         u64 newcarry = (word & ((u64)1<<63)) >> 63;
         word <<= 1;
         word |= carry;
         carry = newcarry;
-        a->d[i] = word;
+        d[i] = word;
     }
-    if (carry) bufpush(a->d, carry);
+    if (carry) bigint_push(a, carry);
     bigint_normalize(a);
 }
 
@@ -177,14 +241,15 @@ void bigint_shln(bigint* a, usize n) {
 }
 
 void bigint_shr(bigint* a) {
+    u64* d = bigint_words(a);
     u64 carry = 0;
-    bufrevloop(a->d, i) {
-        u64 word = a->d[i];
+    for (usize i = a->len; i-- > 0;) {
+        u64 word = d[i];
         u64 newcarry = word & 1;
         word >>= 1;
         word |= (carry<<63);
         carry = newcarry;
-        a->d[i] = word;
+        d[i] = word;
     }
     bigint_normalize(a);
 }
@@ -197,124 +262,479 @@ void bigint_set_bit(bigint* a, usize bit, bool set) {
     usize word_idx = bit / U64_BITS;
     usize bit_idx_in_word = bit % U64_BITS;
 
-    while (buflen(a->d) < word_idx+1) bufpush(a->d, 0);
-    u64 word = a->d[word_idx];
+    if (a->len < word_idx+1) bigint_resize(a, word_idx+1);
+    u64* d = bigint_words(a);
+    u64 word = d[word_idx];
     u64 val = set ? 1 : 0;
     word |= val<<bit_idx_in_word;
-    a->d[word_idx] = word;
+    d[word_idx] = word;
     bigint_normalize(a);
 }
 
-static u64 word_mul_hi(u64 a, u64 b) {
-    usize n = U64_BITS/2;
-    u64 ahi = a >> n;
-    u64 alo = a & WORD_HALF_MASK;
-    u64 bhi = b >> n;
-    u64 blo = b & WORD_HALF_MASK;
-    u64 tmp = ((alo*blo) >> n) + ahi*blo;
-    tmp = (tmp >> n) + ((alo*bhi + (tmp & WORD_HALF_MASK)) >> n);
-    return tmp + ahi*bhi;
+// Adds `a` (na words) into `r` (nr words, nr >= na) and returns
+// the carry out of the top word.
+static u64 words_add_into(u64* r, usize nr, const u64* a, usize na) {
+    u64 carry = 0;
+    usize i;
+    for (i = 0; i < na; i++) {
+        u128 sum = (u128)r[i] + a[i] + carry;
+        r[i] = (u64)sum;
+        carry = (u64)(sum >> 64);
+    }
+    for (; i < nr && carry; i++) {
+        carry = add_wcarry(&r[i], carry);
+    }
+    return carry;
 }
 
-void bigint_mul(bigint* a, const bigint* b) {
-    usize na = buflen(a->d);
-    usize nb = buflen(b->d);
-    usize nc = na + nb + 1;
-
-    bigint c = bigint_new();
-    c.neg = (int)a->neg ^ (int)b->neg;
-    while (buflen(c.d) != nc) {
-        bufpush(c.d, 0);
+// Subtracts `a` (na words) from `r` (nr words, nr >= na) and returns
+// the borrow out of the top word.
+static u64 words_sub_into(u64* r, usize nr, const u64* a, usize na) {
+    u64 borrow = 0;
+    usize i;
+    for (i = 0; i < na; i++) {
+        borrow =  sub_wcarry(&r[i], borrow);
+        borrow += sub_wcarry(&r[i], a[i]);
     }
-
-    bigint carries = bigint_new();
-    while (buflen(carries.d) != nc) {
-        bufpush(carries.d, 0);
+    for (; i < nr && borrow; i++) {
+        borrow = sub_wcarry(&r[i], borrow);
     }
+    return borrow;
+}
+
+static void words_mul(u64* r, const u64* a, usize na, const u64* b, usize nb);
 
+static void words_mul_schoolbook(u64* r, const u64* a, usize na, const u64* b, usize nb) {
+    memset(r, 0, (na+nb) * sizeof(u64));
     for (usize ia = 0; ia < na; ia++) {
+        u64 carry = 0;
         for (usize ib = 0; ib < nb; ib++) {
-            usize i = ia + ib;
-            usize j = i + 1;
-            carries.d[i+1] += add_wcarry(&c.d[i], a->d[ia] * b->d[ib]);
-            carries.d[j+1] += add_wcarry(
-                &c.d[j],
-                word_mul_hi(a->d[ia], b->d[ib]));
+            u128 t = (u128)a[ia] * b[ib] + r[ia+ib] + carry;
+            r[ia+ib] = (u64)t;
+            carry = (u64)(t >> 64);
+        }
+        r[ia+nb] = carry;
+    }
+}
+
+// a*b = z2*B^2m + ((a0+a1)(b0+b1) - z2 - z0)*B^m + z0,
+// where z0 = a0*b0, z2 = a1*b1 and B^m splits the operands.
+static void words_mul_karatsuba(u64* r, const u64* a, usize na, const u64* b, usize nb) {
+    usize m = MIN(na, nb) / 2;
+    const u64* a0 = a;
+    const u64* a1 = a + m;
+    const u64* b0 = b;
+    const u64* b1 = b + m;
+    usize na1 = na - m;
+    usize nb1 = nb - m;
+
+    words_mul(r, a0, m, b0, m);
+    words_mul(r + 2*m, a1, na1, b1, nb1);
+
+    usize nsa = na1 + 1;
+    usize nsb = nb1 + 1;
+    usize nz1 = nsa + nsb;
+    u64* sa = malloc((nsa + nsb + nz1) * sizeof(u64));
+    u64* sb = sa + nsa;
+    u64* z1 = sb + nsb;
+
+    memcpy(sa, a1, na1 * sizeof(u64));
+    sa[na1] = 0;
+    words_add_into(sa, nsa, a0, m);
+    memcpy(sb, b1, nb1 * sizeof(u64));
+    sb[nb1] = 0;
+    words_add_into(sb, nsb, b0, m);
+
+    words_mul(z1, sa, nsa, sb, nsb);
+    words_sub_into(z1, nz1, r, 2*m);
+    words_sub_into(z1, nz1, r + 2*m, na1 + nb1);
+    while (nz1 > 0 && z1[nz1-1] == 0) nz1--;
+    words_add_into(r + m, na + nb - m, z1, nz1);
+
+    free(sa);
+}
+
+// Writes the na+nb word product of `a` and `b` to `r`,
+// which must not overlap either operand.
+static void words_mul(u64* r, const u64* a, usize na, const u64* b, usize nb) {
+    if (na < nb) {
+        SWAP_VARS(const u64*, a, b);
+        SWAP_VARS(usize, na, nb);
+    }
+
+    if (nb < BIGINT_KARATSUBA_THRESHOLD) {
+        words_mul_schoolbook(r, a, na, b, nb);
+    } else if (na >= 2*nb) {
+        // Unbalanced operands are multiplied in nb-sized chunks
+        // of `a` so that each product stays balanced.
+        memset(r, 0, (na+nb) * sizeof(u64));
+        u64* tmp = malloc(2*nb * sizeof(u64));
+        for (usize i = 0; i < na; i += nb) {
+            usize len = MIN(nb, na - i);
+            words_mul(tmp, a + i, len, b, nb);
+            words_add_into(r + i, na + nb - i, tmp, len + nb);
         }
+        free(tmp);
+    } else {
+        words_mul_karatsuba(r, a, na, b, nb);
     }
-    bigint_add_unsigned(&c, &carries);
+}
+
+// Multiplies `a` by `m` and adds `add` in place.
+static void bigint_mul_add_u64(bigint* a, u64 m, u64 add) {
+    u64* d = bigint_words(a);
+    u64 carry = add;
+    for (usize i = 0; i < a->len; i++) {
+        u128 t = (u128)d[i] * m + carry;
+        d[i] = (u64)t;
+        carry = (u64)(t >> 64);
+    }
+    if (carry) bigint_push(a, carry);
+}
+
+void bigint_mul(bigint* a, const bigint* b) {
+    usize na = a->len;
+    usize nb = b->len;
+    bool neg = (int)a->neg ^ (int)b->neg;
+
+    // Single word operands have an inline product.
+    if (na <= 1 && nb <= 1) {
+        bigint_set_u128(a, (u128)bigint_low_u64(a) * bigint_low_u64(b));
+        a->neg = neg;
+        bigint_normalize(a);
+        return;
+    }
+
+    // A single word multiplier is applied in place.
+    if (nb == 1 && a != b) {
+        bigint_mul_add_u64(a, bigint_cwords(b)[0], 0);
+        a->neg = neg;
+        bigint_normalize(a);
+        return;
+    }
+
+    bigint c = bigint_new();
+    bigint_resize(&c, na + nb);
+    words_mul(bigint_words(&c), bigint_cwords(a), na, bigint_cwords(b), nb);
+    c.neg = neg;
 
-    bigint_free(&carries);
     bigint_free(a);
     *a = c;
     bigint_normalize(a);
 }
 
-void bigint_div_mod(const bigint* num, const bigint* den, bigint* quo, bigint* rem) {
-    // TODO: error on division by zero
-    bigint_copy(rem, num);
-    bigint_set_u64(quo, 0);
+static u64 words_divmod_word(u64* q, const u64* u, usize nu, u64 v) {
+    u64 rem = 0;
+    for (usize i = nu; i-- > 0;) {
+        u128 cur = ((u128)rem << 64) | u[i];
+        q[i] = (u64)(cur / v);
+        rem = (u64)(cur % v);
+    }
+    return rem;
+}
 
-    if (bigint_cmp_abs(rem, den) >= 0) {
-        bigint ourden = bigint_new();
-        bigint_copy(&ourden, den);
+static int word_clz(u64 w) {
+    int n = 0;
+    while (!(w & ((u64)1<<63))) {
+        w <<= 1;
+        n++;
+    }
+    return n;
+}
 
-        int n = (int)(bigint_bitlength(rem) - bigint_bitlength(&ourden));
-        bigint_shln(&ourden, (usize)n);
+// Knuth's Algorithm D (TAOCP Vol. 2, 4.3.1). Divides `u` (nu words)
+// by `v` (nv >= 2 words, top word non-zero, nu >= nv), writing
+// nu-nv+1 quotient words to `q` and nv remainder words to `r`.
+static void words_divmod_knuth(u64* q, u64* r, const u64* u, usize nu, const u64* v, usize nv) {
+    // D1: normalize so that the top bit of the divisor is set.
+    int sh = word_clz(v[nv-1]);
+    u64* vn = malloc((nv + nu + 1) * sizeof(u64));
+    u64* un = vn + nv;
+    for (usize i = nv-1; i > 0; i--) {
+        vn[i] = (v[i] << sh) | (sh ? v[i-1] >> (64-sh) : 0);
+    }
+    vn[0] = v[0] << sh;
+    un[nu] = sh ? u[nu-1] >> (64-sh) : 0;
+    for (usize i = nu-1; i > 0; i--) {
+        un[i] = (u[i] << sh) | (sh ? u[i-1] >> (64-sh) : 0);
+    }
+    un[0] = u[0] << sh;
+
+    for (usize j = nu - nv + 1; j-- > 0;) {
+        // D3: estimate the quotient digit from the top two words.
+        u128 num = ((u128)un[j+nv] << 64) | un[j+nv-1];
+        u128 qhat = num / vn[nv-1];
+        u128 rhat = num % vn[nv-1];
+        while ((qhat >> 64) != 0
+               || qhat * vn[nv-2] > ((rhat << 64) | un[j+nv-2])) {
+            qhat--;
+            rhat += vn[nv-1];
+            if ((rhat >> 64) != 0) break;
+        }
 
-        for (; n >= 0; n--) {
-            if (bigint_cmp_abs(rem, &ourden) >= 0) {
-                bigint_sub_unsigned(rem, &ourden);
-                bigint_set_bit(quo, n, true);
-            }
-            bigint_shr(&ourden);
+        // D4: multiply and subtract.
+        u64 borrow = 0;
+        u64 carry = 0;
+        for (usize i = 0; i < nv; i++) {
+            u128 p = qhat * vn[i] + carry;
+            carry = (u64)(p >> 64);
+            borrow =  sub_wcarry(&un[i+j], borrow);
+            borrow += sub_wcarry(&un[i+j], (u64)p);
         }
+        borrow =  sub_wcarry(&un[j+nv], borrow);
+        borrow += sub_wcarry(&un[j+nv], carry);
 
-        bigint_free(&ourden);
+        // D6: the estimate was one too large, add back.
+        if (borrow) {
+            qhat--;
+            un[j+nv] += words_add_into(&un[j], nv, vn, nv);
+        }
+        q[j] = (u64)qhat;
     }
-    quo->neg = (int)num->neg ^ (int)den->neg;
-    rem->neg = rem->neg;
 
-    bigint_normalize(quo);
-    bigint_normalize(rem);
+    // D8: unnormalize the remainder.
+    for (usize i = 0; i < nv; i++) {
+        r[i] = (un[i] >> sh) | (sh ? un[i+1] << (64-sh) : 0);
+    }
+    free(vn);
+}
+
+void bigint_div_mod(const bigint* num, const bigint* den, bigint* quo, bigint* rem) {
+    // TODO: error on division by zero
+    bool quo_neg = (int)num->neg ^ (int)den->neg;
+    bool rem_neg = num->neg;
+
+    if (den->len == 0 || bigint_cmp_abs(num, den) < 0) {
+        bigint_copy(rem, num);
+        bigint_set_u64(quo, 0);
+        return;
+    }
+
+    // Values that fit in 128 bits are divided natively.
+    if (bigint_fits_u128(num) && bigint_fits_u128(den)) {
+        u128 n = bigint_get_u128(num);
+        u128 d = bigint_get_u128(den);
+        bigint_set_u128(quo, n / d);
+        bigint_set_u128(rem, n % d);
+        quo->neg = quo_neg;
+        rem->neg = rem_neg;
+        bigint_normalize(quo);
+        bigint_normalize(rem);
+        return;
+    }
+
+    usize nu = num->len;
+    usize nv = den->len;
+    bigint q = bigint_new();
+    bigint r = bigint_new();
+    bigint_resize(&q, nu - nv + 1);
+    bigint_resize(&r, nv);
+    if (nv == 1) {
+        bigint_words(&r)[0] = words_divmod_word(
+            bigint_words(&q),
+            bigint_cwords(num),
+            nu,
+            bigint_cwords(den)[0]);
+    } else {
+        words_divmod_knuth(
+            bigint_words(&q),
+            bigint_words(&r),
+            bigint_cwords(num),
+            nu,
+            bigint_cwords(den),
+            nv);
+    }
+    q.neg = quo_neg;
+    r.neg = rem_neg;
+    bigint_normalize(&q);
+    bigint_normalize(&r);
+
+    bigint_free(quo);
+    bigint_free(rem);
+    *quo = q;
+    *rem = r;
 }
 
 bool bigint_fits(const bigint* a, int bytes, bool signd) {
-    if ((!signd && a->neg) || buflen(a->d) > 1) return false;
-    if (buflen(a->d) == 0) return true;
+    if ((!signd && a->neg) || a->len > 1) return false;
+    if (a->len == 0) return true;
 
+    u64 d = bigint_low_u64(a);
     if (signd) {
         u64 max = maxinteger_signed(bytes);
         if (a->neg) {
-            if (a->d[0] > max+1) return false;
+            if (d > max+1) return false;
             else return true;
         } else {
-            if (a->d[0] > max) return false;
+            if (d > max) return false;
             else return true;
         }
     } else {
-        if (u64_bitlength(a->d[0]) > (u64)(bytes*8)) return false;
+        if (u64_bitlength(d) > (u64)(bytes*8)) return false;
         else return true;
     }
 }
 
-char* bigint_tostring(const bigint* a) {
-    char* str = NULL;
-    if (buflen(a->d) == 0) {
-        bufpush(str, '0');
+// Largest power of `base` that fits in a word, and its exponent.
+static u64 radix_chunk(u64 base, usize* digits) {
+    u64 pow = base;
+    usize n = 1;
+    while (pow <= UINT64_MAX / base) {
+        pow *= base;
+        n++;
+    }
+    *digits = n;
+    return pow;
+}
+
+// Returns log2(base) for power-of-two bases, 0 otherwise.
+static int radix_shift(u64 base) {
+    switch (base) {
+        case 2:  return 1;
+        case 4:  return 2;
+        case 8:  return 3;
+        case 16: return 4;
+    }
+    return 0;
+}
+
+static bigint bigint_pow_u64(u64 base, usize exp) {
+    bigint result = bigint_new_u64(1);
+    bigint sq = bigint_new_u64(base);
+    while (exp) {
+        if (exp & 1) bigint_mul(&result, &sq);
+        exp >>= 1;
+        if (exp) bigint_mul(&sq, &sq);
+    }
+    bigint_free(&sq);
+    return result;
+}
+
+// Parses `n` digit values into `a`, which must be zero. Digits are
+// folded in a word-sized chunk at a time, and very long inputs are
+// split in half so that the halves are joined with one big multiply.
+static void radix_parse(bigint* a, const u8* digits, usize n, u64 base) {
+    if (n > BIGINT_RADIX_DC_DIGITS) {
+        usize nlo = n / 2;
+        bigint lo = bigint_new();
+        radix_parse(a, digits, n - nlo, base);
+        radix_parse(&lo, digits + n - nlo, nlo, base);
+        bigint pow = bigint_pow_u64(base, nlo);
+        bigint_mul(a, &pow);
+        bigint_add(a, &lo);
+        bigint_free(&pow);
+        bigint_free(&lo);
+        return;
+    }
+
+    usize chunk_digits;
+    u64 chunk_pow = radix_chunk(base, &chunk_digits);
+    usize k = n % chunk_digits;
+    if (k == 0) k = chunk_digits;
+    for (usize i = 0; i < n; i += k, k = chunk_digits) {
+        u64 chunk = 0;
+        u64 pow = 1;
+        if (k == chunk_digits) pow = chunk_pow;
+        else for (usize j = 0; j < k; j++) pow *= base;
+        for (usize j = 0; j < k; j++) chunk = chunk*base + digits[i+j];
+        bigint_mul_add_u64(a, pow, chunk);
+    }
+}
+
+bigint bigint_from_digits(const char* str, usize len, u64 base) {
+    u8* digits = NULL;
+    for (usize i = 0; i < len; i++) {
+        if (str[i] != '_') bufpush(digits, (u8)char_to_digit(str[i]));
+    }
+    usize n = buflen(digits);
+
+    bigint a = bigint_new();
+    int shift = radix_shift(base);
+    if (shift) {
+        bigint_resize(&a, (n*shift + U64_BITS-1) / U64_BITS);
+        u64* d = bigint_words(&a);
+        for (usize i = 0; i < n; i++) {
+            u64 v = digits[n-1-i];
+            usize pos = i*shift;
+            usize bit = pos % U64_BITS;
+            d[pos / U64_BITS] |= v << bit;
+            if (bit + shift > U64_BITS) d[pos/U64_BITS + 1] |= v >> (U64_BITS - bit);
+        }
     } else {
-        bigint tmp = bigint_new();
-        bigint_copy(&tmp, a);
+        radix_parse(&a, digits, n, base);
+    }
+    bigint_normalize(&a);
+
+    buffree(digits);
+    return a;
+}
+
+static const char* radix_alpha = "0123456789abcdef";
+
+// Pushes the digits of the magnitude of `a` to `str` least significant
+// first, zero padded to at least `width` digits.
+static void radix_write(char** str, const bigint* a, u64 base, usize width) {
+    usize written = 0;
+    int shift = radix_shift(base);
+    if (shift) {
+        const u64* d = bigint_cwords(a);
+        usize n = (bigint_bitlength(a) + shift-1) / shift;
+        for (usize i = 0; i < n; i++) {
+            usize pos = i*shift;
+            usize bit = pos % U64_BITS;
+            u64 v = d[pos / U64_BITS] >> bit;
+            if (bit + shift > U64_BITS && pos/U64_BITS + 1 < a->len) {
+                v |= d[pos/U64_BITS + 1] << (U64_BITS - bit);
+            }
+            bufpush(*str, radix_alpha[v & (base-1)]);
+        }
+        written = n;
+    } else if (a->len > BIGINT_RADIX_DC_WORDS) {
+        // Split around base^m, roughly the square root of `a`, and
+        // convert both halves. The low half is padded to m digits.
+        usize chunk_digits;
+        u64 chunk_pow = radix_chunk(base, &chunk_digits);
+        usize chunks = a->len / 2;
+        usize m = chunks * chunk_digits;
+        bigint pow = bigint_pow_u64(chunk_pow, chunks);
         bigint quo = bigint_new();
         bigint rem = bigint_new();
-        bigint base = bigint_new_u64(10);
-        char* alpha = "0123456789abcdef";
-
-        while (buflen(tmp.d) > 0) {
-            bigint_div_mod(&tmp, &base, &quo, &rem);
-            bigint_copy(&tmp, &quo);
-            bufpush(str, alpha[rem.d[0]]);
+        bigint_div_mod(a, &pow, &quo, &rem);
+        quo.neg = false;
+        rem.neg = false;
+        radix_write(str, &rem, base, m);
+        radix_write(str, &quo, base, width > m ? width - m : 0);
+        bigint_free(&pow);
+        bigint_free(&quo);
+        bigint_free(&rem);
+        return;
+    } else {
+        usize chunk_digits;
+        u64 chunk_pow = radix_chunk(base, &chunk_digits);
+        usize n = a->len;
+        u64* scratch = malloc(MAX(n, 1) * sizeof(u64));
+        memcpy(scratch, bigint_cwords(a), n * sizeof(u64));
+        while (n > 0) {
+            u64 r = words_divmod_word(scratch, scratch, n, chunk_pow);
+            while (n > 0 && scratch[n-1] == 0) n--;
+            for (usize k = 0; k < chunk_digits && (n > 0 || r > 0); k++) {
+                bufpush(*str, radix_alpha[r % base]);
+                r /= base;
+                written++;
+            }
         }
+        free(scratch);
+    }
+
+    for (; written < width; written++) bufpush(*str, '0');
+}
+
+char* bigint_tostring_radix(const bigint* a, u64 base) {
+    char* str = NULL;
+    if (a->len == 0) {
+        bufpush(str, '0');
+    } else {
+        radix_write(&str, a, base, 0);
         if (a->neg) bufpush(str, '-');
 
         usize len = buflen(str);
@@ -330,6 +750,10 @@ char* bigint_tostring(const bigint* a) {
     return str;
 }
 
+char* bigint_tostring(const bigint* a) {
+    return bigint_tostring_radix(a, 10);
+}
+
 void test_bigint() {
     /*
     {
@@ -382,8 +806,9 @@ void test_bigint() {
 
     {
         bigint a = bigint_new();
-        bufpush(a.d, 0b1001011101001100001011010111100000000000000000000000000000000000);
-        bufpush(a.d, 0b1000001000000000000100011100011011000001010010110010111010);
+        bigint_resize(&a, 2);
+        bigint_words(&a)[0] = 0b1001011101001100001011010111100000000000000000000000000000000000;
+        bigint_words(&a)[1] = 0b1000001000000000000100011100011011000001010010110010111010;
 
         bigint b = bigint_new_u64(3);
 
@@ -399,6 +824,76 @@ void test_bigint() {
         bigint a = bigint_new_u64(7);
         bigint b = bigint_new_u64(3);
         bigint_sub(&a, &b);
-        assert(a.d[0] == 4);
+        assert(bigint_low_u64(&a) == 4);
+    }
+
+    {
+        bigint a = bigint_new_u64(UINT64_MAX);
+        bigint b = bigint_new_u64(UINT64_MAX);
+        bigint_mul(&a, &b);
+        assert(a.heap == NULL);
+        bigint_mul(&a, &b);
+        assert(a.heap != NULL);
+        assert(strcmp("6277101735386680762814942322444851025767571854389858533375", bigint_tostring(&a)) == 0);
+
+        bigint quo = bigint_new();
+        bigint rem = bigint_new();
+        bigint_div_mod(&a, &b, &quo, &rem);
+        assert(strcmp("340282366920938463426481119284349108225", bigint_tostring(&quo)) == 0);
+        assert(rem.len == 0);
+    }
+
+    {
+        u64 seed = 88172645463325252ull;
+        bigint a = bigint_new();
+        bigint b = bigint_new();
+        bigint c = bigint_new();
+        bigint_resize(&a, 150);
+        bigint_resize(&b, 70);
+        bigint_resize(&c, 40);
+        bigint* nums[] = { &a, &b, &c };
+        for (usize n = 0; n < 3; n++) {
+            for (usize i = 0; i < nums[n]->len; i++) {
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                bigint_words(nums[n])[i] = seed;
+            }
+        }
+
+        bigint prod = bigint_new();
+        bigint_copy(&prod, &a);
+        bigint_mul(&prod, &b);
+        bigint expected = bigint_new();
+        bigint_resize(&expected, a.len + b.len);
+        words_mul_schoolbook(bigint_words(&expected), bigint_cwords(&a), a.len, bigint_cwords(&b), b.len);
+        bigint_normalize(&expected);
+        assert(bigint_cmp(&prod, &expected) == 0);
+
+        bigint_add(&prod, &c);
+        bigint quo = bigint_new();
+        bigint rem = bigint_new();
+        bigint_div_mod(&prod, &b, &quo, &rem);
+        assert(bigint_cmp(&quo, &a) == 0);
+        assert(bigint_cmp(&rem, &c) == 0);
+
+        bigint ten = bigint_new_u64(10);
+        bigint_div_mod(&prod, &ten, &quo, &rem);
+        bigint_mul(&quo, &ten);
+        bigint_add(&quo, &rem);
+        assert(bigint_cmp(&quo, &prod) == 0);
+    }
+
+    {
+        bigint a = bigint_from_digits("1_000_000", 9, 10);
+        assert(bigint_low_u64(&a) == 1000000);
+        a = bigint_from_digits("dead_BEEF", 9, 16);
+        assert(bigint_low_u64(&a) == 0xdeadbeef);
+        a = bigint_from_digits("0000000000000000000000000012", 28, 10);
+        assert(strcmp("12", bigint_tostring(&a)) == 0);
+        a = bigint_from_digits("777", 3, 8);
+        assert(strcmp("111111111", bigint_tostring_radix(&a, 2)) == 0);
+        a = bigint_from_digits("100000000000000000000000000000000000000", 39, 10);
+        assert(strcmp("4b3b4ca85a86c47a098a224000000000", bigint_tostring_radix(&a, 16)) == 0);
     }
 }
@@ -3,8 +3,14 @@
 
 #include "core.h"
 
+#define BIGINT_INLINE_WORDS 2
+
+// Magnitudes of up to BIGINT_INLINE_WORDS words (128 bits) are
+// stored inline, wider ones spill to a heap buffer.
 typedef struct {
-    u64* d;
+    u64 inl[BIGINT_INLINE_WORDS];
+    u64* heap;
+    usize len;
     bool neg;
 } bigint;
 
@@ -17,6 +23,8 @@ void bigint_clear(bigint* a);
 void bigint_normalize(bigint* a);
 void bigint_set_u64(bigint* a, u64 num);
 usize bigint_bitlength(const bigint* a);
+// Returns the lowest 64 bits of the magnitude.
+u64 bigint_low_u64(const bigint* a);
 void bigint_copy(bigint* dest, const bigint* src);
 void bigint_free(bigint* a);
 int bigint_cmp_abs(const bigint* a, const bigint* b);
@@ -35,6 +43,9 @@ void bigint_set_bit(bigint* a, usize bit, bool set);
 void bigint_mul(bigint* a, const bigint* b);
 void bigint_div_mod(const bigint* num, const bigint* den, bigint* quo, bigint* rem);
 bool bigint_fits(const bigint* a, int bytes, bool signd);
+// Parses `len` digits of `str` in `base`, skipping `_` separators.
+bigint bigint_from_digits(const char* str, usize len, u64 base);
+char* bigint_tostring_radix(const bigint* a, u64 base);
 char* bigint_tostring(const bigint* a);
 void test_bigint();
 
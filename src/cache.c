@@ -0,0 +1,262 @@
+#include "cache.h"
+#include "compile.h"
+#include "ast.h"
+#include "type.h"
+#include "buf.h"
+
+#include <llvm/Config/llvm-config.h>
+
+// Bump when the cached bitcode changes meaning.
+#define CACHE_FORMAT "aria-cache-1"
+
+// 128-bit FNV-1a.
+static void hash_bytes(u128* hash, const void* data, usize len) {
+    const u128 prime = ((u128)0x0000000001000000 << 64) | 0x000000000000013b;
+    const u8* bytes = (const u8*)data;
+    for (usize i = 0; i < len; i++) {
+        *hash ^= bytes[i];
+        *hash *= prime;
+    }
+}
+
+static u128 hash_new() {
+    return ((u128)0x6c62272e07bb0142 << 64) | 0x62b821756295c58d;
+}
+
+// Strings are hashed with their terminator so that
+// consecutive ones can't run together.
+static void hash_str(u128* hash, const char* str) {
+    hash_bytes(hash, str, strlen(str)+1);
+}
+
+static void hash_u64(u128* hash, u64 n) {
+    hash_bytes(hash, &n, sizeof(n));
+}
+
+static char* hash_tostring(u128 hash) {
+    return format_string("%016lx%016lx", (u64)(hash >> 64), (u64)hash);
+}
+
+char* cache_get_dir() {
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    char* base = NULL;
+    if (xdg && xdg[0] == '/') {
+        base = format_string("%s", xdg);
+    } else {
+        const char* home = getenv("HOME");
+        if (!home || home[0] == '\0') return NULL;
+        base = format_string("%s/.cache", home);
+        if (mkdir(base, 0755) == -1 && errno != EEXIST) return NULL;
+    }
+    char* dir = format_string("%s/aria", base);
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) return NULL;
+    return dir;
+}
+
+// Hashes a global's initializer, which sema has folded into a
+// literal. Importers inline these values, so they are part of the
+// interface even when the type isn't comptime.
+static void cache_hash_value(u128* hash, AstNode* astnode) {
+    hash_u64(hash, astnode->kind);
+    if (astnode->typespec) hash_str(hash, typespec_tostring(astnode->typespec));
+    if (astnode->typespec && typespec_is_unsized_integer(astnode->typespec)) {
+        hash_str(hash, bigint_tostring(&astnode->typespec->prim.integer));
+        return;
+    }
+
+    switch (astnode->kind) {
+        case ASTNODE_INTEGER_LITERAL: {
+            hash_str(hash, bigint_tostring(&astnode->intl.val));
+        } break;
+
+        case ASTNODE_STRING_LITERAL: {
+            hash_u64(hash, buflen(astnode->strl.token->str));
+            hash_bytes(hash, astnode->strl.token->str, buflen(astnode->strl.token->str));
+        } break;
+
+        case ASTNODE_CHAR_LITERAL: {
+            hash_u64(hash, (u64)astnode->cl.token->c);
+        } break;
+
+        case ASTNODE_BUILTIN_SYMBOL: {
+            hash_u64(hash, astnode->bsym.kind);
+        } break;
+
+        case ASTNODE_ARRAY_LITERAL: {
+            hash_u64(hash, buflen(astnode->arrayl.elems));
+            bufloop(astnode->arrayl.elems, i) {
+                cache_hash_value(hash, astnode->arrayl.elems[i]);
+            }
+        } break;
+
+        case ASTNODE_AGGREGATE_LITERAL: {
+            hash_u64(hash, buflen(astnode->aggl.fields));
+            bufloop(astnode->aggl.fields, i) {
+                hash_u64(hash, astnode->aggl.fields[i]->field.idx);
+                cache_hash_value(hash, astnode->aggl.fields[i]->field.value);
+            }
+        } break;
+
+        case ASTNODE_CAST: {
+            cache_hash_value(hash, astnode->cast.left);
+        } break;
+
+        default: {
+            // Anything else is hashed by its source text.
+            Span span = astnode->span;
+            hash_bytes(hash, &span.srcfile->handle.contents[span.start], span.end - span.start);
+        } break;
+    }
+}
+
+// What other modules see of `mod`: the names and types of its
+// top-level declarations, and the values of its immutable globals.
+static u128 cache_hash_interface(Typespec* mod) {
+    Srcfile* srcfile = mod->mod.srcfile;
+    u128 hash = hash_new();
+    hash_u64(&hash, srcfile->id);
+    bufloop(srcfile->astnodes, i) {
+        AstNode* astnode = srcfile->astnodes[i];
+        switch (astnode->kind) {
+            case ASTNODE_FUNCTION_DEF: {
+                hash_str(&hash, astnode->funcdef.export ? "export fn" : "fn");
+                hash_str(&hash, astnode->funcdef.header->funch.name);
+                hash_str(&hash, typespec_tostring(astnode->typespec));
+            } break;
+
+            case ASTNODE_EXTERN_FUNCTION: {
+                hash_str(&hash, "extern fn");
+                hash_str(&hash, astnode->extfunc.header->funch.name);
+                hash_str(&hash, typespec_tostring(astnode->typespec));
+            } break;
+
+            case ASTNODE_VARIABLE_DECL: {
+                hash_str(&hash, astnode->vard.immutable ? "imm" : "mut");
+                hash_str(&hash, astnode->vard.name);
+                hash_str(&hash, typespec_tostring(astnode->typespec));
+                if (typespec_is_comptime(astnode->typespec)) {
+                    hash_str(&hash, bigint_tostring(&astnode->typespec->prim.integer));
+                } else if (astnode->vard.immutable && astnode->vard.initializer) {
+                    cache_hash_value(&hash, astnode->vard.initializer);
+                }
+            } break;
+
+            case ASTNODE_EXTERN_VARIABLE: {
+                hash_str(&hash, "extern var");
+                hash_str(&hash, astnode->extvar.name);
+                hash_str(&hash, typespec_tostring(astnode->typespec));
+            } break;
+
+            case ASTNODE_STRUCT: {
+                hash_str(&hash, astnode->strct.packed ? "packed struct" : "struct");
+                hash_str(&hash, astnode->strct.name);
+                bufloop(astnode->strct.fields, j) {
+                    AstNode* field = astnode->strct.fields[j];
+                    hash_str(&hash, token_tostring(field->field.key));
+                    hash_str(&hash, typespec_tostring(field->typespec));
+                }
+            } break;
+        }
+    }
+    return hash;
+}
+
+static void cache_mark_reachable(Typespec* mod, bool* reachable) {
+    Srcfile* srcfile = mod->mod.srcfile;
+    bufloop(srcfile->astnodes, i) {
+        AstNode* astnode = srcfile->astnodes[i];
+        if (astnode->kind != ASTNODE_IMPORT) continue;
+        u64 id = astnode->import.mod_ty->mod.srcfile->id;
+        if (reachable[id]) continue;
+        reachable[id] = true;
+        cache_mark_reachable(astnode->import.mod_ty, reachable);
+    }
+}
+
+// Identifies the compiler binary, so that rebuilding
+// it invalidates everything it cached.
+static void cache_hash_compiler(u128* hash) {
+    hash_str(hash, CACHE_FORMAT);
+    hash_str(hash, LLVM_VERSION_STRING);
+    struct stat st;
+    if (stat(g_exec_path, &st) == 0) {
+        hash_u64(hash, (u64)st.st_size);
+        hash_u64(hash, (u64)st.st_mtim.tv_sec);
+        hash_u64(hash, (u64)st.st_mtim.tv_nsec);
+    }
+}
+
+void cache_compute_keys(CompileCtx* c) {
+    usize nmods = buflen(c->mod_tys);
+    u128* interfaces = NULL;
+    bufloop(c->mod_tys, i) {
+        // Modules are numbered in the order they are read.
+        assert(c->mod_tys[i]->mod.srcfile->id == i);
+        bufpush(interfaces, cache_hash_interface(c->mod_tys[i]));
+    }
+
+    u128 common = hash_new();
+    cache_hash_compiler(&common);
+    hash_str(&common, c->target_triple);
+    hash_str(&common, c->cpu);
+    hash_str(&common, c->features);
+    hash_str(&common, opt_level_tostring(c->opt_level));
+
+    bool* reachable = (bool*)malloc(nmods * sizeof(bool));
+    bufloop(c->mod_tys, i) {
+        Srcfile* srcfile = c->mod_tys[i]->mod.srcfile;
+        u128 hash = common;
+        hash_u64(&hash, srcfile->id);
+        hash_u64(&hash, srcfile->handle.len);
+        hash_bytes(&hash, srcfile->handle.contents, srcfile->handle.len);
+
+        memset(reachable, 0, nmods * sizeof(bool));
+        cache_mark_reachable(c->mod_tys[i], reachable);
+        for (usize j = 0; j < nmods; j++) {
+            if (j != i && reachable[j]) hash_bytes(&hash, &interfaces[j], sizeof(u128));
+        }
+        srcfile->cache_key = hash_tostring(hash);
+    }
+    free(reachable);
+    buffree(interfaces);
+}
+
+static char* cache_get_path(const char* dir, const char* key) {
+    return format_string("%s/%s.bc", dir, key);
+}
+
+bool cache_load(const char* dir, const char* key, LLVMMemoryBufferRef* bitcode) {
+    char* errors = NULL;
+    char* path = cache_get_path(dir, key);
+    bool found = !LLVMCreateMemoryBufferWithContentsOfFile(path, bitcode, &errors);
+    if (errors) LLVMDisposeMessage(errors);
+    free(path);
+    return found;
+}
+
+// The entry is written under a temporary name and renamed into
+// place, so concurrent builds never see a partial file. Failing to
+// write is not an error, the module is just not cached.
+void cache_store(const char* dir, const char* key, LLVMMemoryBufferRef bitcode) {
+    char* path = cache_get_path(dir, key);
+    char* tmppath = format_string("%s.XXXXXX", path);
+    int fd = mkstemp(tmppath);
+    if (fd != -1) {
+        const char* data = LLVMGetBufferStart(bitcode);
+        usize len = LLVMGetBufferSize(bitcode);
+        bool ok = true;
+        while (len != 0) {
+            ssize_t written = write(fd, data, len);
+            if (written <= 0) {
+                ok = false;
+                break;
+            }
+            data += written;
+            len -= (usize)written;
+        }
+        if (close(fd) != 0) ok = false;
+        if (!ok || rename(tmppath, path) != 0) unlink(tmppath);
+    }
+    free(tmppath);
+    free(path);
+}
@@ -0,0 +1,23 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "core.h"
+
+#include <llvm-c/Core.h>
+
+struct CompileCtx;
+
+// Returns the module cache directory, `$XDG_CACHE_HOME/aria` or
+// `~/.cache/aria`, creating it if needed. NULL if it can't be used.
+char* cache_get_dir();
+// Sets every module's cache key. A key covers the module's source,
+// the interfaces of all modules reachable through its imports and
+// the compiler and flags that affect code generation. Must be run
+// after sema has resolved the declarations.
+void cache_compute_keys(struct CompileCtx* c);
+
+// Both are safe to call from codegen threads.
+bool cache_load(const char* dir, const char* key, LLVMMemoryBufferRef* bitcode);
+void cache_store(const char* dir, const char* key, LLVMMemoryBufferRef bitcode);
+
+#endif
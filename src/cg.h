@@ -6,12 +6,52 @@
 #include <llvm-c/Core.h>
 #include <llvm-c/TargetMachine.h>
 #include <llvm-c/Analysis.h>
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Comdat.h>
+#include <llvm-c/IRReader.h>
+#include <llvm-c/Linker.h>
 #include <llvm-c/Transforms/PassBuilder.h>
 
 struct Typespec;
 struct CompileCtx;
 struct AstNode;
 
+typedef struct {
+    LLVMTypeRef llvmtype;
+    LLVMValueRef llvmvalue;
+    bool live;
+} CgTempSlot;
+
+// An element of an aggregate literal built in place: element `idx`
+// of the place `parent`, or of the destination if it's -1. Its
+// address is only built once something is stored there.
+typedef struct {
+    isize parent;
+    LLVMTypeRef parent_llvmtype;
+    unsigned idx;
+    LLVMValueRef llvmvalue;
+    struct Typespec* typespec;
+    // The value to store. NULL for literals stored element by element,
+    // and for aggregates already copied into place.
+    LLVMValueRef value;
+} CgPlace;
+
+// The destination of a literal built in place. A `fresh` one can't be
+// observed until the literal is done; a temporary (`addr` NULL) is
+// only allocated once something has to be written to it.
+typedef struct {
+    LLVMValueRef addr;
+    LLVMTypeRef llvmtype;
+    bool fresh;
+} CgLiteralDest;
+
+// A `break` with a value, for the phi at the end of its loop.
+typedef struct {
+    LLVMValueRef llvmvalue;
+    LLVMBasicBlockRef llvmbb;
+} CgBreak;
+
 typedef struct {
     struct Typespec** mod_tys;
     struct CompileCtx* compile_ctx;
@@ -19,15 +59,34 @@ typedef struct {
 
     struct Typespec* current_mod_ty;
     struct AstNode* current_func;
+    LLVMValueRef current_llvmfunc;
     LLVMBasicBlockRef current_bb;
+    // AST nodes are shared by the workers, so everything generated
+    // for them is kept here. Addresses of the current function's
+    // params and locals are indexed by `paramd.idx` and `vard.idx`.
+    LLVMValueRef* param_llvmvalues;
+    LLVMValueRef* local_llvmvalues;
+    // The local every `return` returns, if any. It's built in
+    // place in the by-ref return slot.
+    struct AstNode* ret_local;
+    CgBreak* breaks;
     LLVMBasicBlockRef* loop_cond_stack;
     LLVMBasicBlockRef* loop_end_stack;
+    // Entry block allocas for temporaries of the current function.
+    // A slot is free again once the statement that took it ends,
+    // unless its address was taken while `pin_temp_slots` was set.
+    CgTempSlot* temp_slots;
+    usize* live_temp_slots;
+    bool pin_temp_slots;
 
+    // Every module is generated in its own context on a worker
+    // thread, then linked into the root context's module.
+    LLVMContextRef llvmctx;
     LLVMBuilderRef llvmbuilder;
     LLVMModuleRef llvmmod;
-    LLVMTargetRef llvmtarget;
     LLVMTargetMachineRef llvmtargetmachine;
-    LLVMTargetDataRef llvmtargetdatalayout;
+    // A module's bitcode, handed from its worker to the linker.
+    LLVMMemoryBufferRef llvmbitcode;
 
     LLVMTypeRef llvmptrtype;
 } CgCtx;
@@ -3,22 +3,48 @@
 #include "type.h"
 #include "buf.h"
 #include "compile.h"
+#include "cache.h"
+
+#include <pthread.h>
+
+// Functions from IR inputs up to this size are imported for
+// inlining with thin LTO. Same as LLVM's default import limit.
+#define IMPORT_INSTR_LIMIT 100
 
 CgCtx cg_new_context(struct Typespec** mod_tys, struct CompileCtx* compile_ctx) {
     CgCtx c;
     c.mod_tys = mod_tys;
     c.current_mod_ty = NULL;
     c.current_func = NULL;
+    c.current_llvmfunc = NULL;
     c.current_bb = NULL;
+    c.param_llvmvalues = NULL;
+    c.local_llvmvalues = NULL;
+    c.ret_local = NULL;
+    c.breaks = NULL;
     c.loop_cond_stack = NULL;
     c.loop_end_stack = NULL;
+    c.temp_slots = NULL;
+    c.live_temp_slots = NULL;
+    c.pin_temp_slots = false;
     c.compile_ctx = compile_ctx;
     c.error = false;
+    c.llvmctx = NULL;
+    c.llvmbuilder = NULL;
+    c.llvmmod = NULL;
+    c.llvmtargetmachine = NULL;
+    c.llvmbitcode = NULL;
+    c.llvmptrtype = NULL;
     return c;
 }
 
+// Messages can come from several codegen threads at once.
+static pthread_mutex_t msg_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static inline void msg_emit(CgCtx* c, Msg* msg) {
+    pthread_mutex_lock(&msg_lock);
     _msg_emit(msg, c->compile_ctx);
+    pthread_mutex_unlock(&msg_lock);
     if (msg->kind == MSG_ERROR) {
         c->error = true;
     }
@@ -31,9 +57,11 @@ static char* mangle_name(CgCtx* c, char* name) {
         name);
 }
 
-static LLVMTypeRef cg_get_llvm_type(CgCtx* c, Typespec* typespec) {
-    if (typespec->llvmtype) return typespec->llvmtype;
+static LLVMTypeRef cg_get_struct_type(CgCtx* c, AstNode* strct);
 
+// Types aren't cached on the typespec because each module has its
+// own context. LLVM uniques them, so building one again is cheap.
+static LLVMTypeRef cg_get_llvm_type(CgCtx* c, Typespec* typespec) {
     switch (typespec->kind) {
         case TS_PRIM: {
             switch (typespec->prim.kind) {
@@ -45,16 +73,13 @@ static LLVMTypeRef cg_get_llvm_type(CgCtx* c, Typespec* typespec) {
                 case PRIM_i16:
                 case PRIM_i32:
                 case PRIM_i64:
-                    typespec->llvmtype = LLVMIntType(typespec_get_bytes(typespec) * 8);
-                    break;
+                    return LLVMIntTypeInContext(c->llvmctx, typespec_get_bytes(typespec) * 8);
 
                 case PRIM_bool:
-                    typespec->llvmtype = LLVMInt8Type();
-                    break;
+                    return LLVMInt8TypeInContext(c->llvmctx);
 
                 case PRIM_INTEGER:
-                    typespec->llvmtype = LLVMInt64Type();
-                    break;
+                    return LLVMInt64TypeInContext(c->llvmctx);
 
                 default: assert(0 && "cg_get_llvm_type()");
             }
@@ -62,21 +87,16 @@ static LLVMTypeRef cg_get_llvm_type(CgCtx* c, Typespec* typespec) {
 
         case TS_void:
         case TS_noreturn:
-            typespec->llvmtype = LLVMVoidType();
-            break;
+            return LLVMVoidTypeInContext(c->llvmctx);
 
         case TS_PTR:
-            typespec->llvmtype = c->llvmptrtype;
-            break;
-
         case TS_MULTIPTR:
-            typespec->llvmtype = c->llvmptrtype;
-            break;
+            return c->llvmptrtype;
 
         case TS_ARRAY: {
-            typespec->llvmtype = LLVMArrayType(
+            return LLVMArrayType(
                     cg_get_llvm_type(c, typespec->array.child),
-                    typespec->array.size->prim.integer.d[0]);
+                    bigint_low_u64(&typespec->array.size->prim.integer));
         } break;
 
         case TS_SLICE: {
@@ -84,7 +104,7 @@ static LLVMTypeRef cg_get_llvm_type(CgCtx* c, Typespec* typespec) {
             LLVMTypeRef elems[2];
             elems[0] = c->llvmptrtype;
             elems[1] = cg_get_llvm_type(c, predef_typespecs.u64_type->ty);
-            typespec->llvmtype = LLVMStructType(elems, 2, false);
+            return LLVMStructTypeInContext(c->llvmctx, elems, 2, false);
         } break;
 
         case TS_FUNC: {
@@ -94,115 +114,214 @@ static LLVMTypeRef cg_get_llvm_type(CgCtx* c, Typespec* typespec) {
             bufloop(params, i) {
                 bufpush(param_llvmtypes, cg_get_llvm_type(c, params[i]));
             }
-            LLVMTypeRef ret_llvmtype = cg_get_llvm_type(c, ret);
-            typespec->llvmtype = LLVMFunctionType(
+            // Aggregates are returned through a trailing out pointer.
+            LLVMTypeRef ret_llvmtype = NULL;
+            if (typespec_is_pass_by_ref(ret)) {
+                ret_llvmtype = LLVMVoidTypeInContext(c->llvmctx);
+                bufpush(param_llvmtypes, c->llvmptrtype);
+            } else {
+                ret_llvmtype = cg_get_llvm_type(c, ret);
+            }
+            LLVMTypeRef llvmtype = LLVMFunctionType(
                 ret_llvmtype,
                 param_llvmtypes,
-                buflen(params),
+                buflen(param_llvmtypes),
                 false);
+            buffree(param_llvmtypes);
+            return llvmtype;
         } break;
 
         case TS_STRUCT:
-            typespec->llvmtype = typespec->agg.ref->strct.llvmtype;
-            break;
+            return cg_get_struct_type(c, typespec->agg.ref);
 
         default: assert(0 && "cg_get_llvm_type()");
     }
-    return typespec->llvmtype;
+    return NULL;
+}
+
+// Named structs are created in a context the first time
+// one of its modules uses them.
+static LLVMTypeRef cg_get_struct_type(CgCtx* c, AstNode* strct) {
+    LLVMTypeRef llvmtype = LLVMGetTypeByName2(c->llvmctx, strct->strct.mangled_name);
+    if (llvmtype) return llvmtype;
+
+    llvmtype = LLVMStructCreateNamed(c->llvmctx, strct->strct.mangled_name);
+    LLVMTypeRef* field_llvmtypes = NULL;
+    bufloop(strct->strct.fields, i) {
+        bufpush(field_llvmtypes, cg_get_llvm_type(c, strct->strct.fields[i]->typespec));
+    }
+    LLVMStructSetBody(
+        llvmtype,
+        field_llvmtypes,
+        buflen(field_llvmtypes),
+        strct->strct.packed);
+    buffree(field_llvmtypes);
+    return llvmtype;
 }
 
 LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* target, void* addl_info);
+LLVMValueRef cg_access_struct_field(CgCtx* c, LLVMValueRef struct_value, LLVMTypeRef struct_ty, usize idx, bool lvalue, LLVMTypeRef field_ty);
+LLVMValueRef cg_access_array_element(CgCtx* c, LLVMValueRef array, LLVMValueRef index, LLVMTypeRef array_ty, bool lvalue);
+
+// Lets inlining and the vectorizer use the selected CPU's
+// instructions even in functions optimized on their own.
+static void cg_add_target_attributes(CgCtx* c, LLVMValueRef fn) {
+    const char* cpu = c->compile_ctx->cpu;
+    const char* features = c->compile_ctx->features;
+    LLVMAddAttributeAtIndex(
+        fn,
+        LLVMAttributeFunctionIndex,
+        LLVMCreateStringAttribute(c->llvmctx, "target-cpu", 10, cpu, strlen(cpu)));
+    if (features[0] != '\0') {
+        LLVMAddAttributeAtIndex(
+            fn,
+            LLVMAttributeFunctionIndex,
+            LLVMCreateStringAttribute(c->llvmctx, "target-features", 15, features, strlen(features)));
+    }
+}
 
-static void cg_top_level_decls_prec1(CgCtx* c, AstNode* astnode) {
-    switch (astnode->kind) {
-        case ASTNODE_STRUCT: {
-            astnode->strct.mangled_name = mangle_name(c, astnode->strct.name);
-            astnode->strct.llvmtype = LLVMStructCreateNamed(
-                LLVMGetGlobalContext(),
-                astnode->strct.mangled_name);
-        } break;
+static LLVMAttributeRef cg_enum_attribute(CgCtx* c, const char* name, u64 val) {
+    unsigned kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+    return LLVMCreateEnumAttribute(c->llvmctx, kind, val);
+}
+
+static LLVMAttributeRef cg_sret_attribute(CgCtx* c, Typespec* ret_ty) {
+    unsigned kind = LLVMGetEnumAttributeKindForName("sret", 4);
+    return LLVMCreateTypeAttribute(c->llvmctx, kind, cg_get_llvm_type(c, ret_ty));
+}
+
+static bool cg_has_known_size(Typespec* ty) {
+    switch (ty->kind) {
+        case TS_PRIM:
+        case TS_PTR:
+        case TS_MULTIPTR:
+        case TS_SLICE:
+        case TS_ARRAY:
+        case TS_STRUCT: return typespec_get_bytes(ty) != 0;
     }
+    return false;
 }
 
-static void cg_function_header(CgCtx* c, AstNode* header, bool should_mangle) {
-    header->funch.mangled_name = should_mangle ? mangle_name(c, header->funch.name) : header->funch.name;
-    LLVMTypeRef* param_llvmtypes = NULL;
-    bufloop(header->funch.params, i) {
-        cg_get_llvm_type(c, header->funch.params[i]->typespec);
-        bufpush(param_llvmtypes, header->funch.params[i]->typespec->llvmtype);
+// Attributes that follow from Aria's types: nothing unwinds, a
+// `*imm T` param is only read and always points to a T, and the
+// by-ref return slot is a fresh local the callee writes to.
+static void cg_add_function_attributes(CgCtx* c, LLVMValueRef fn, Typespec* func_ty) {
+    LLVMAddAttributeAtIndex(fn, LLVMAttributeFunctionIndex, cg_enum_attribute(c, "nounwind", 0));
+    Typespec* ret_ty = func_ty->func.ret_typespec;
+    if (ret_ty->kind == TS_noreturn) {
+        LLVMAddAttributeAtIndex(fn, LLVMAttributeFunctionIndex, cg_enum_attribute(c, "noreturn", 0));
     }
-    LLVMTypeRef ret_llvmtype = NULL;
-    bool ret_by_ref = false;
-    if (typespec_is_pass_by_ref(header->typespec->func.ret_typespec)) {
-        ret_by_ref = true;
-        ret_llvmtype = cg_get_llvm_type(c, predef_typespecs.void_type->ty);
-        bufpush(param_llvmtypes, c->llvmptrtype);
-    } else {
-        ret_llvmtype = cg_get_llvm_type(c, header->typespec->func.ret_typespec);
+
+    usize params_len = buflen(func_ty->func.params);
+    for (usize i = 0; i < params_len; i++) {
+        Typespec* param_ty = func_ty->func.params[i];
+        if (param_ty->kind != TS_PTR || !param_ty->ptr.immutable) continue;
+        LLVMAttributeIndex idx = (LLVMAttributeIndex)i + 1;
+        LLVMAddAttributeAtIndex(fn, idx, cg_enum_attribute(c, "readonly", 0));
+        LLVMAddAttributeAtIndex(fn, idx, cg_enum_attribute(c, "nonnull", 0));
+        if (cg_has_known_size(param_ty->ptr.child)) {
+            LLVMAddAttributeAtIndex(
+                fn,
+                idx,
+                cg_enum_attribute(c, "dereferenceable", typespec_get_bytes(param_ty->ptr.child)));
+        }
     }
-    header->funch.ret_typespec->typespec->llvmtype = ret_llvmtype;
 
-    header->typespec->llvmtype = LLVMFunctionType(
-        ret_llvmtype,
-        param_llvmtypes,
-        ret_by_ref ? buflen(header->funch.params)+1 : buflen(header->funch.params),
-        false);
+    if (typespec_is_pass_by_ref(ret_ty)) {
+        LLVMAttributeIndex idx = (LLVMAttributeIndex)params_len + 1;
+        LLVMAddAttributeAtIndex(fn, idx, cg_sret_attribute(c, ret_ty));
+        LLVMAddAttributeAtIndex(fn, idx, cg_enum_attribute(c, "noalias", 0));
+    }
 }
 
-static void cg_top_level_decls_prec2(CgCtx* c, AstNode* astnode) {
+// Names are assigned up front because the modules that
+// reference a declaration are generated concurrently.
+static void cg_mangle_top_level_decl(CgCtx* c, AstNode* astnode) {
     switch (astnode->kind) {
+        case ASTNODE_STRUCT: {
+            astnode->strct.mangled_name = mangle_name(c, astnode->strct.name);
+        } break;
+
         case ASTNODE_VARIABLE_DECL: {
-            cg_get_llvm_type(c, astnode->typespec);
             astnode->vard.mangled_name = mangle_name(c, astnode->vard.name);
-            astnode->llvmvalue = LLVMAddGlobal(
-                c->llvmmod,
-                astnode->typespec->llvmtype,
-                astnode->vard.mangled_name);
-            if (astnode->vard.initializer) {
-                LLVMValueRef initializer_llvmvalue = cg_astnode(c, astnode->vard.initializer, false, astnode->typespec, NULL);
-                LLVMSetInitializer(astnode->llvmvalue, initializer_llvmvalue);
-            } else {
-                LLVMSetInitializer(astnode->llvmvalue, LLVMConstNull(astnode->typespec->llvmtype));
-            }
         } break;
 
-        case ASTNODE_EXTERN_VARIABLE: {
-            cg_get_llvm_type(c, astnode->typespec);
-            astnode->llvmvalue = LLVMAddGlobal(
-                c->llvmmod,
-                astnode->typespec->llvmtype,
-                astnode->extvar.name);
-            LLVMSetExternallyInitialized(astnode->llvmvalue, true);
+        case ASTNODE_FUNCTION_DEF: {
+            AstNode* header = astnode->funcdef.header;
+            header->funch.mangled_name = astnode->funcdef.export
+                ? header->funch.name
+                : mangle_name(c, header->funch.name);
         } break;
 
-        case ASTNODE_FUNCTION_DEF: {
-            cg_function_header(c, astnode->funcdef.header, !astnode->funcdef.export);
-            astnode->llvmvalue = LLVMAddFunction(
-                c->llvmmod,
-                astnode->funcdef.header->funch.mangled_name,
-                astnode->typespec->llvmtype);
+        case ASTNODE_EXTERN_FUNCTION: {
+            AstNode* header = astnode->extfunc.header;
+            header->funch.mangled_name = header->funch.name;
         } break;
+    }
+}
 
+// Top-level declarations are looked up by symbol name in the
+// current module. Ones from other modules are declared on first use
+// and resolved when the modules are linked.
+static LLVMValueRef cg_get_decl_llvmvalue(CgCtx* c, AstNode* decl) {
+    switch (decl->kind) {
+        case ASTNODE_FUNCTION_DEF:
         case ASTNODE_EXTERN_FUNCTION: {
-            cg_function_header(c, astnode->extfunc.header, false);
-            astnode->llvmvalue = LLVMAddFunction(
-                c->llvmmod,
-                astnode->extfunc.header->funch.mangled_name,
-                astnode->typespec->llvmtype);
+            AstNode* header = decl->kind == ASTNODE_FUNCTION_DEF
+                ? decl->funcdef.header
+                : decl->extfunc.header;
+            LLVMValueRef fn = LLVMGetNamedFunction(c->llvmmod, header->funch.mangled_name);
+            if (!fn) {
+                fn = LLVMAddFunction(
+                    c->llvmmod,
+                    header->funch.mangled_name,
+                    cg_get_llvm_type(c, decl->typespec));
+                cg_add_function_attributes(c, fn, decl->typespec);
+            }
+            return fn;
         } break;
 
-        case ASTNODE_STRUCT: {
-            LLVMTypeRef* field_llvmtypes = NULL;
-            bufloop(astnode->strct.fields, i) {
-                cg_get_llvm_type(c, astnode->strct.fields[i]->typespec);
-                bufpush(field_llvmtypes, astnode->strct.fields[i]->typespec->llvmtype);
+        case ASTNODE_VARIABLE_DECL:
+        case ASTNODE_EXTERN_VARIABLE: {
+            if (decl->kind == ASTNODE_VARIABLE_DECL && decl->vard.stack) return c->local_llvmvalues[decl->vard.idx];
+            const char* name = decl->kind == ASTNODE_VARIABLE_DECL
+                ? decl->vard.mangled_name
+                : decl->extvar.name;
+            bool immutable = decl->kind == ASTNODE_VARIABLE_DECL
+                ? decl->vard.immutable
+                : decl->extvar.immutable;
+            LLVMValueRef global = LLVMGetNamedGlobal(c->llvmmod, name);
+            if (!global) {
+                global = LLVMAddGlobal(
+                    c->llvmmod,
+                    cg_get_llvm_type(c, decl->typespec),
+                    name);
+                LLVMSetGlobalConstant(global, immutable);
+                if (decl->kind == ASTNODE_EXTERN_VARIABLE) {
+                    LLVMSetExternallyInitialized(global, true);
+                }
             }
+            return global;
+        } break;
 
-            LLVMStructSetBody(
-                astnode->strct.llvmtype,
-                field_llvmtypes,
-                buflen(field_llvmtypes),
-                astnode->strct.packed);
+        case ASTNODE_PARAM_DECL: {
+            return c->param_llvmvalues[decl->paramd.idx];
+        } break;
+    }
+    assert(0);
+    return NULL;
+}
+
+static void cg_top_level_decls(CgCtx* c, AstNode* astnode) {
+    switch (astnode->kind) {
+        case ASTNODE_VARIABLE_DECL:
+        case ASTNODE_EXTERN_VARIABLE:
+        case ASTNODE_EXTERN_FUNCTION: {
+            cg_get_decl_llvmvalue(c, astnode);
+        } break;
+
+        case ASTNODE_FUNCTION_DEF: {
+            cg_add_target_attributes(c, cg_get_decl_llvmvalue(c, astnode));
         } break;
     }
 }
@@ -224,6 +343,316 @@ static void cg_place_builder_at(CgCtx* c, LLVMBasicBlockRef bb) {
     LLVMPositionBuilderAtEnd(c->llvmbuilder, bb);
 }
 
+// Temporaries get their stack slot in the entry block, so a loop
+// doesn't grow the stack and mem2reg can see them.
+static LLVMValueRef cg_get_temp_slot(CgCtx* c, LLVMTypeRef llvmtype) {
+    usize idx = buflen(c->temp_slots);
+    bufloop(c->temp_slots, i) {
+        if (!c->temp_slots[i].live && c->temp_slots[i].llvmtype == llvmtype) {
+            idx = i;
+            break;
+        }
+    }
+    if (idx == buflen(c->temp_slots)) {
+        LLVMBasicBlockRef bb = LLVMGetInsertBlock(c->llvmbuilder);
+        LLVMBasicBlockRef entry = LLVMGetEntryBasicBlock(c->current_llvmfunc);
+        LLVMValueRef first = LLVMGetFirstInstruction(entry);
+        if (first) LLVMPositionBuilderBefore(c->llvmbuilder, first);
+        else LLVMPositionBuilderAtEnd(c->llvmbuilder, entry);
+        LLVMValueRef slot = LLVMBuildAlloca(c->llvmbuilder, llvmtype, "tmp");
+        LLVMPositionBuilderAtEnd(c->llvmbuilder, bb);
+        bufpush(c->temp_slots, (CgTempSlot){ llvmtype, slot, false });
+    }
+
+    c->temp_slots[idx].live = true;
+    if (!c->pin_temp_slots) bufpush(c->live_temp_slots, idx);
+    return c->temp_slots[idx].llvmvalue;
+}
+
+static void cg_release_temp_slots(CgCtx* c, usize mark) {
+    while (buflen(c->live_temp_slots) > mark) {
+        c->temp_slots[*buflast(c->live_temp_slots)].live = false;
+        bufpop(c->live_temp_slots);
+    }
+}
+
+static bool cg_is_by_ref_call(AstNode* astnode) {
+    return astnode->kind == ASTNODE_FUNCTION_CALL && typespec_is_pass_by_ref(astnode->typespec);
+}
+
+static LLVMValueRef cg_get_const_global(CgCtx* c, LLVMValueRef value) {
+    LLVMValueRef global = LLVMAddGlobal(c->llvmmod, LLVMTypeOf(value), "");
+    LLVMSetLinkage(global, LLVMPrivateLinkage);
+    LLVMSetGlobalConstant(global, true);
+    LLVMSetUnnamedAddress(global, LLVMGlobalUnnamedAddr);
+    LLVMSetInitializer(global, value);
+    return global;
+}
+
+// NULL elements are left undefined.
+static LLVMValueRef cg_build_const_literal(LLVMTypeRef llvmtype, LLVMValueRef* elems) {
+    bufloop(elems, i) {
+        if (!elems[i]) elems[i] = LLVMGetUndef(LLVMStructGetTypeAtIndex(llvmtype, i));
+    }
+    return LLVMGetTypeKind(llvmtype) == LLVMArrayTypeKind
+        ? LLVMConstArray(LLVMGetElementType(llvmtype), elems, buflen(elems))
+        : LLVMConstNamedStruct(llvmtype, elems, buflen(elems));
+}
+
+// Builds an array or struct value from `elems`, where NULL elements
+// are left undefined. Fully constant literals are built as constants.
+static LLVMValueRef cg_build_literal(CgCtx* c, LLVMTypeRef llvmtype, LLVMValueRef* elems) {
+    bool constant = true;
+    bufloop(elems, i) {
+        if (elems[i] && !LLVMIsConstant(elems[i])) constant = false;
+    }
+    if (constant) return cg_build_const_literal(llvmtype, elems);
+
+    LLVMValueRef value = LLVMGetUndef(llvmtype);
+    bufloop(elems, i) {
+        if (elems[i]) value = LLVMBuildInsertValue(c->llvmbuilder, value, elems[i], i, "");
+    }
+    return value;
+}
+
+static bool cg_is_aggregate(Typespec* ty) {
+    return ty->kind == TS_ARRAY || ty->kind == TS_STRUCT;
+}
+
+static bool cg_is_literal(AstNode* astnode) {
+    return astnode->kind == ASTNODE_ARRAY_LITERAL || astnode->kind == ASTNODE_AGGREGATE_LITERAL;
+}
+
+// Whether `astnode` can be evaluated as an lvalue, so that copying
+// it doesn't need its value in registers.
+static bool cg_is_in_memory(AstNode* astnode) {
+    switch (astnode->kind) {
+        case ASTNODE_SYMBOL: {
+            AstNode* ref = astnode->sym.ref;
+            return ref->kind == ASTNODE_VARIABLE_DECL
+                || ref->kind == ASTNODE_EXTERN_VARIABLE
+                || ref->kind == ASTNODE_PARAM_DECL;
+        } break;
+
+        case ASTNODE_ACCESS:
+        case ASTNODE_INDEX:
+        case ASTNODE_DEREF:
+            return true;
+
+        case ASTNODE_FUNCTION_CALL:
+            return cg_is_by_ref_call(astnode);
+    }
+    return false;
+}
+
+static void cg_build_memcpy(CgCtx* c, LLVMValueRef dest, LLVMValueRef src, Typespec* ty, bool may_overlap) {
+    unsigned align = (unsigned)typespec_get_align(ty);
+    LLVMValueRef size = LLVMConstInt(LLVMInt64TypeInContext(c->llvmctx), typespec_get_bytes(ty), false);
+    if (may_overlap) LLVMBuildMemMove(c->llvmbuilder, dest, align, src, align, size);
+    else LLVMBuildMemCpy(c->llvmbuilder, dest, align, src, align, size);
+}
+
+// Zeroes are memset, other constants are copied from a read-only global.
+static void cg_build_const_store(CgCtx* c, LLVMValueRef dest, LLVMValueRef value, Typespec* ty) {
+    if (LLVMIsNull(value)) {
+        LLVMBuildMemSet(
+            c->llvmbuilder,
+            dest,
+            LLVMConstInt(LLVMInt8TypeInContext(c->llvmctx), 0, false),
+            LLVMConstInt(LLVMInt64TypeInContext(c->llvmctx), typespec_get_bytes(ty), false),
+            (unsigned)typespec_get_align(ty));
+    } else {
+        cg_build_memcpy(c, dest, cg_get_const_global(c, value), ty, false);
+    }
+}
+
+static LLVMValueRef cg_get_place_addr(CgCtx* c, CgPlace* places, usize idx, CgLiteralDest* dest) {
+    CgPlace* place = &places[idx];
+    if (!place->llvmvalue) {
+        LLVMValueRef parent = NULL;
+        if (place->parent != -1) {
+            parent = cg_get_place_addr(c, places, place->parent, dest);
+        } else {
+            if (!dest->addr) dest->addr = cg_get_temp_slot(c, dest->llvmtype);
+            parent = dest->addr;
+        }
+        place->llvmvalue = LLVMGetTypeKind(place->parent_llvmtype) == LLVMArrayTypeKind
+            ? cg_access_array_element(
+                c,
+                parent,
+                LLVMConstInt(LLVMInt64TypeInContext(c->llvmctx), place->idx, false),
+                place->parent_llvmtype,
+                true)
+            : cg_access_struct_field(c, parent, place->parent_llvmtype, place->idx, true, NULL);
+    }
+    return place->llvmvalue;
+}
+
+// Evaluates the elements of `literal` into `places`, below the place
+// `parent` (-1 for the destination itself), and stores them later.
+// Returns the literal's value if it's a constant. Aggregates in memory
+// are copied straight into a fresh destination as they're evaluated,
+// rather than loaded: nothing can observe it in the meantime, while
+// later elements could still write to the source.
+static LLVMValueRef cg_eval_literal_parts(CgCtx* c, AstNode* literal, isize parent, CgLiteralDest* dest, CgPlace** places) {
+    LLVMTypeRef llvmtype = cg_get_llvm_type(c, literal->typespec);
+    bool is_array = literal->kind == ASTNODE_ARRAY_LITERAL;
+    usize count = is_array ? buflen(literal->arrayl.elems) : LLVMCountStructElementTypes(llvmtype);
+    usize start = buflen(*places);
+    bool constant = true;
+    LLVMValueRef* elems = NULL;
+    for (usize i = 0; i < count; i++) {
+        bufpush(elems, NULL);
+    }
+
+    usize len = is_array ? buflen(literal->arrayl.elems) : buflen(literal->aggl.fields);
+    for (usize i = 0; i < len; i++) {
+        AstNode* expr = is_array ? literal->arrayl.elems[i] : literal->aggl.fields[i]->field.value;
+        Typespec* ty = is_array ? literal->typespec->array.child : literal->aggl.fields[i]->typespec;
+        unsigned idx = is_array ? i : literal->aggl.fields[i]->field.idx;
+        usize place = buflen(*places);
+        bufpush(*places, (CgPlace){ parent, llvmtype, idx, NULL, ty, NULL });
+
+        LLVMValueRef value = NULL;
+        if (cg_is_literal(expr)) {
+            // A constant element is stored as a whole.
+            value = cg_eval_literal_parts(c, expr, place, dest, places);
+        } else if (dest->fresh && cg_is_aggregate(ty) && cg_is_in_memory(expr)) {
+            LLVMValueRef src = cg_astnode(c, expr, true, NULL, NULL);
+            cg_build_memcpy(c, cg_get_place_addr(c, *places, place, dest), src, ty, false);
+            constant = false;
+            continue;
+        } else {
+            value = cg_astnode(c, expr, false, ty, NULL);
+        }
+        (*places)[place].value = value;
+        elems[idx] = value;
+        if (!value || !LLVMIsConstant(value)) constant = false;
+    }
+
+    LLVMValueRef value = NULL;
+    if (constant) {
+        value = cg_build_const_literal(llvmtype, elems);
+        while (buflen(*places) > start) bufpop(*places);
+    }
+    buffree(elems);
+    return value;
+}
+
+static void cg_build_literal_stores(CgCtx* c, CgLiteralDest* dest, CgPlace* places) {
+    bufloop(places, i) {
+        CgPlace* place = &places[i];
+        if (!place->value) continue;
+        LLVMValueRef addr = cg_get_place_addr(c, places, i, dest);
+        if (cg_is_aggregate(place->typespec) && LLVMIsConstant(place->value)) {
+            cg_build_const_store(c, addr, place->value, place->typespec);
+        } else {
+            LLVMBuildStore(c->llvmbuilder, place->value, addr);
+        }
+    }
+}
+
+// Constructs `literal` field by field in `addr`, instead of building
+// the whole aggregate as a value first.
+static void cg_build_literal_into(CgCtx* c, LLVMValueRef addr, AstNode* literal, bool fresh) {
+    CgPlace* places = NULL;
+    CgLiteralDest dest = { addr, cg_get_llvm_type(c, literal->typespec), fresh };
+    LLVMValueRef value = cg_eval_literal_parts(c, literal, -1, &dest, &places);
+    if (value) cg_build_const_store(c, addr, value, literal->typespec);
+    else cg_build_literal_stores(c, &dest, places);
+    buffree(places);
+}
+
+// Constant literals live in a read-only global, others in a temporary.
+static LLVMValueRef cg_build_literal_in_memory(CgCtx* c, AstNode* literal) {
+    CgPlace* places = NULL;
+    CgLiteralDest dest = { NULL, cg_get_llvm_type(c, literal->typespec), true };
+    LLVMValueRef value = cg_eval_literal_parts(c, literal, -1, &dest, &places);
+    if (value) {
+        dest.addr = cg_get_const_global(c, value);
+    } else {
+        cg_build_literal_stores(c, &dest, places);
+        if (!dest.addr) dest.addr = cg_get_temp_slot(c, dest.llvmtype);
+    }
+    buffree(places);
+    return dest.addr;
+}
+
+// Copies the aggregate `expr` into `dest` with memcpy, or memmove if
+// the two can overlap. Values only known at runtime are stored.
+static void cg_build_aggregate_copy(CgCtx* c, LLVMValueRef dest, AstNode* expr, Typespec* ty, bool may_overlap) {
+    if (cg_is_literal(expr)) {
+        cg_build_literal_into(c, dest, expr, !may_overlap);
+    } else if (cg_is_in_memory(expr)) {
+        LLVMValueRef src = cg_astnode(c, expr, true, NULL, NULL);
+        cg_build_memcpy(c, dest, src, ty, may_overlap && !cg_is_by_ref_call(expr));
+    } else {
+        LLVMValueRef value = cg_astnode(c, expr, false, ty, NULL);
+        if (LLVMIsConstant(value)) cg_build_const_store(c, dest, value, ty);
+        else LLVMBuildStore(c->llvmbuilder, value, dest);
+    }
+}
+
+// Whether `astnode` is storage only the current function can
+// reach: a local whose address is never taken, or a part of one.
+static bool cg_is_private_lvalue(AstNode* astnode) {
+    switch (astnode->kind) {
+        case ASTNODE_ACCESS: {
+            return astnode->acc.left->typespec->kind == TS_STRUCT && cg_is_private_lvalue(astnode->acc.left);
+        } break;
+
+        case ASTNODE_INDEX: {
+            return astnode->idx.left->typespec->kind == TS_ARRAY && cg_is_private_lvalue(astnode->idx.left);
+        } break;
+
+        case ASTNODE_SYMBOL: {
+            AstNode* ref = astnode->sym.ref;
+            return ref->kind == ASTNODE_VARIABLE_DECL && ref->vard.stack && !ref->vard.addr_taken;
+        } break;
+    }
+    return false;
+}
+
+static AstNode* cg_get_ret_local(AstNode* func) {
+    AstNode* local = NULL;
+    bufloop(func->funcdef.returns, i) {
+        AstNode* child = func->funcdef.returns[i]->ret.child;
+        if (!child || child->kind != ASTNODE_SYMBOL) return NULL;
+        AstNode* ref = child->sym.ref;
+        if (ref->kind != ASTNODE_VARIABLE_DECL || !ref->vard.stack) return NULL;
+        if (local && local != ref) return NULL;
+        local = ref;
+    }
+    return local;
+}
+
+// A by-ref result is written by the callee straight into `dest`
+// instead of into a temporary that is then copied. `dest` must not
+// be reachable by the callee.
+static void cg_build_call_into(CgCtx* c, AstNode* call, LLVMValueRef dest) {
+    cg_astnode(c, call, true, NULL, dest);
+}
+
+// Locals that stay in memory are given a lifetime matching their
+// scope, so stack coloring can overlap ones from disjoint blocks.
+static bool cg_needs_lifetime(CgCtx* c, AstNode* stmt) {
+    if (stmt->kind != ASTNODE_VARIABLE_DECL || !stmt->vard.stack) return false;
+    if (typespec_is_comptime(stmt->typespec) || stmt == c->ret_local) return false;
+    return stmt->vard.addr_taken
+        || stmt->typespec->kind == TS_ARRAY
+        || stmt->typespec->kind == TS_STRUCT;
+}
+
+static void cg_build_lifetime_marker(CgCtx* c, const char* name, AstNode* local) {
+    unsigned id = LLVMLookupIntrinsicID(name, strlen(name));
+    LLVMValueRef fn = LLVMGetIntrinsicDeclaration(c->llvmmod, id, &c->llvmptrtype, 1);
+    LLVMValueRef args[2] = {
+        LLVMConstInt(LLVMInt64TypeInContext(c->llvmctx), typespec_get_bytes(local->typespec), false),
+        cg_get_decl_llvmvalue(c, local),
+    };
+    LLVMBuildCall2(c->llvmbuilder, LLVMIntrinsicGetType(c->llvmctx, id, &c->llvmptrtype, 1), fn, args, 2, "");
+}
+
 static LLVMValueRef cg_build_cond_br(
         CgCtx* c,
         LLVMValueRef cond,
@@ -237,7 +666,7 @@ static LLVMValueRef cg_build_cond_br(
             LLVMBuildIntCast2(
                     c->llvmbuilder,
                     cond,
-                    LLVMInt1Type(),
+                    LLVMInt1TypeInContext(c->llvmctx),
                     false,
                     ""),
             then,
@@ -282,7 +711,7 @@ LLVMValueRef cg_access_array_element(
         LLVMTypeRef array_ty,
         bool lvalue) {
     LLVMValueRef indices[2];
-    indices[0] = LLVMConstInt(LLVMInt64Type(), 0, false);
+    indices[0] = LLVMConstInt(LLVMInt64TypeInContext(c->llvmctx), 0, false);
     indices[1] = index;
     return LLVMBuildGEP2(
             c->llvmbuilder,
@@ -295,67 +724,76 @@ LLVMValueRef cg_access_array_element(
 
 LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* target, void* addl_info) {
     assert(astnode->typespec);
+    LLVMValueRef llvmvalue = NULL;
     if (typespec_is_unsized_integer(astnode->typespec)
         && target
-        && astnode->kind != ASTNODE_IF_BRANCH
-        // We don't yet compute bitwise operators at compile-time (some error
-        // messages might be weird because of it), so we don't have the computed result to
-        // return here. Therefore we make LLVM compute it for now, by disallowing
-        // this branch to happen.
-        // TODO: compute bitwise operators at compile-time
-        && astnode->kind != ASTNODE_BITLG_BINOP
-        && astnode->kind != ASTNODE_BITSH_BINOP) {
-        astnode->llvmvalue = LLVMConstInt(
-                typespec_is_sized_integer(target) ? cg_get_llvm_type(c, target) : LLVMInt64Type(),
-                astnode->typespec->prim.integer.neg ? (-astnode->typespec->prim.integer.d[0]) : astnode->typespec->prim.integer.d[0],
+        && astnode->kind != ASTNODE_IF_BRANCH) {
+        llvmvalue = LLVMConstInt(
+                typespec_is_sized_integer(target) ? cg_get_llvm_type(c, target) : LLVMInt64TypeInContext(c->llvmctx),
+                astnode->typespec->prim.integer.neg ? (-bigint_low_u64(&astnode->typespec->prim.integer)) : bigint_low_u64(&astnode->typespec->prim.integer),
                 astnode->typespec->prim.integer.neg);
-        return astnode->llvmvalue;
+        return llvmvalue;
     }
 
     switch (astnode->kind) {
         case ASTNODE_INTEGER_LITERAL: {
-            astnode->llvmvalue = LLVMConstInt(
-                    LLVMIntType(64),
-                    astnode->intl.val.neg ? (-astnode->intl.val.d[0]) : astnode->intl.val.d[0],
+            // Folded literals may have a sized type.
+            llvmvalue = LLVMConstInt(
+                    typespec_is_sized_integer(astnode->typespec) ? cg_get_llvm_type(c, astnode->typespec) : LLVMInt64TypeInContext(c->llvmctx),
+                    astnode->intl.val.neg ? (-bigint_low_u64(&astnode->intl.val)) : bigint_low_u64(&astnode->intl.val),
                     astnode->intl.val.neg);
         } break;
 
         case ASTNODE_STRING_LITERAL: {
-            LLVMValueRef llvmstr = LLVMConstString(
+            LLVMValueRef llvmstr = LLVMConstStringInContext(
+                    c->llvmctx,
                     astnode->strl.token->str,
                     buflen(astnode->strl.token->str),
                     true);
             LLVMValueRef llvmstrloc = LLVMAddGlobal(c->llvmmod, LLVMTypeOf(llvmstr), "");
             LLVMSetLinkage(llvmstrloc, LLVMPrivateLinkage);
+            LLVMSetGlobalConstant(llvmstrloc, true);
+            LLVMSetUnnamedAddress(llvmstrloc, LLVMGlobalUnnamedAddr);
             LLVMSetInitializer(llvmstrloc, llvmstr);
-            astnode->llvmvalue = llvmstrloc;
+            llvmvalue = llvmstrloc;
         } break;
 
         case ASTNODE_CHAR_LITERAL: {
-            cg_get_llvm_type(c, astnode->typespec);
-            astnode->llvmvalue = LLVMConstInt(
-                    astnode->typespec->llvmtype,
+            llvmvalue = LLVMConstInt(
+                    cg_get_llvm_type(c, astnode->typespec),
                     (unsigned long long)astnode->cl.token->c,
                     false);
         } break;
 
         case ASTNODE_ARRAY_LITERAL: {
-            LLVMValueRef array_llvmvalue = LLVMGetUndef(cg_get_llvm_type(c, astnode->typespec));
+            if (lvalue) {
+                llvmvalue = cg_build_literal_in_memory(c, astnode);
+                break;
+            }
+            LLVMValueRef* elems = NULL;
             bufloop(astnode->arrayl.elems, i) {
-                LLVMValueRef child = cg_astnode(c, astnode->arrayl.elems[i], false, astnode->typespec->array.child, NULL);
-                array_llvmvalue = LLVMBuildInsertValue(
-                    c->llvmbuilder,
-                    array_llvmvalue,
-                    child,
-                    i,
-                    "");
+                bufpush(elems, cg_astnode(c, astnode->arrayl.elems[i], false, astnode->typespec->array.child, NULL));
             }
+            llvmvalue = cg_build_literal(c, cg_get_llvm_type(c, astnode->typespec), elems);
+            buffree(elems);
+        } break;
+
+        case ASTNODE_AGGREGATE_LITERAL: {
             if (lvalue) {
-                astnode->llvmvalue = LLVMBuildAlloca(c->llvmbuilder, cg_get_llvm_type(c, astnode->typespec), "");
-                LLVMBuildStore(c->llvmbuilder, array_llvmvalue, astnode->llvmvalue);
-            } else {
-                astnode->llvmvalue = array_llvmvalue;
+                llvmvalue = cg_build_literal_in_memory(c, astnode);
+                break;
+            }
+            LLVMTypeRef llvmtype = cg_get_llvm_type(c, astnode->typespec);
+            LLVMValueRef* elems = NULL;
+            for (unsigned i = 0; i < LLVMCountStructElementTypes(llvmtype); i++) {
+                bufpush(elems, NULL);
             }
+            bufloop(astnode->aggl.fields, i) {
+                AstNode* field = astnode->aggl.fields[i];
+                elems[field->field.idx] = cg_astnode(c, field->field.value, false, field->typespec, NULL);
+            }
+            llvmvalue = cg_build_literal(c, llvmtype, elems);
+            buffree(elems);
         } break;
 
         case ASTNODE_FUNCTION_CALL: {
@@ -381,12 +819,13 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
             }
             LLVMValueRef out = NULL;
             if (ret_by_ref) {
-                out = LLVMBuildAlloca(c->llvmbuilder, cg_get_llvm_type(c, func_ty->func.ret_typespec), "");
+                out = addl_info
+                    ? (LLVMValueRef)addl_info
+                    : cg_get_temp_slot(c, cg_get_llvm_type(c, func_ty->func.ret_typespec));
                 bufpush(arg_llvmvalues, out);
             }
 
-            astnode->typespec->llvmtype = cg_get_llvm_type(c, func_ty->func.ret_typespec);
-            astnode->llvmvalue = LLVMBuildCall2(
+            llvmvalue = LLVMBuildCall2(
                 c->llvmbuilder,
                 cg_get_llvm_type(c, func_ty),
                 callee_llvmvalue,
@@ -394,9 +833,13 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                 ret_by_ref ? buflen(astnode->funcc.args)+1 : buflen(astnode->funcc.args),
                 "");
             if (ret_by_ref) {
-                astnode->llvmvalue = out;
+                LLVMAddCallSiteAttribute(
+                    llvmvalue,
+                    (LLVMAttributeIndex)buflen(astnode->funcc.args) + 1,
+                    cg_sret_attribute(c, func_ty->func.ret_typespec));
+                llvmvalue = out;
                 if (!lvalue) {
-                    astnode->llvmvalue = LLVMBuildLoad2(c->llvmbuilder, astnode->typespec->llvmtype, out, "");
+                    llvmvalue = LLVMBuildLoad2(c->llvmbuilder, cg_get_llvm_type(c, func_ty->func.ret_typespec), out, "");
                 }
             } else if (astnode->typespec->kind == TS_noreturn) {
                 LLVMBuildUnreachable(c->llvmbuilder);
@@ -404,38 +847,35 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
         } break;
 
         case ASTNODE_SYMBOL: {
-            astnode->typespec->llvmtype = astnode->sym.ref->typespec->llvmtype;
-
-            astnode->llvmvalue = lvalue || astnode->sym.ref->kind == ASTNODE_FUNCTION_DEF || astnode->sym.ref->kind == ASTNODE_EXTERN_FUNCTION
-                ? astnode->sym.ref->llvmvalue
-                : LLVMBuildLoad2(c->llvmbuilder, astnode->sym.ref->typespec->llvmtype, astnode->sym.ref->llvmvalue, "");
+            LLVMValueRef ref_llvmvalue = cg_get_decl_llvmvalue(c, astnode->sym.ref);
+            llvmvalue = lvalue || astnode->sym.ref->kind == ASTNODE_FUNCTION_DEF || astnode->sym.ref->kind == ASTNODE_EXTERN_FUNCTION
+                ? ref_llvmvalue
+                : LLVMBuildLoad2(c->llvmbuilder, cg_get_llvm_type(c, astnode->sym.ref->typespec), ref_llvmvalue, "");
         } break;
 
         case ASTNODE_BUILTIN_SYMBOL: {
             switch (astnode->bsym.kind) {
                 case BS_true: {
-                    cg_get_llvm_type(c, astnode->typespec);
-                    astnode->llvmvalue = LLVMConstInt(LLVMInt8Type(), 1, false);
+                    llvmvalue = LLVMConstInt(LLVMInt8TypeInContext(c->llvmctx), 1, false);
                 } break;
 
                 case BS_false: {
-                    cg_get_llvm_type(c, astnode->typespec);
-                    astnode->llvmvalue = LLVMConstInt(LLVMInt8Type(), 0, false);
+                    llvmvalue = LLVMConstInt(LLVMInt8TypeInContext(c->llvmctx), 0, false);
                 } break;
             }
         } break;
 
         case ASTNODE_CAST: {
-            astnode->llvmvalue = cg_astnode(c, astnode->cast.left, false, astnode->cast.right->typespec->ty, NULL);
+            llvmvalue = cg_astnode(c, astnode->cast.left, false, astnode->cast.right->typespec->ty, NULL);
 
             Typespec* left = astnode->cast.left->typespec;
             assert(astnode->cast.right->typespec->kind == TS_TYPE);
             Typespec* right = astnode->cast.right->typespec->ty;
 
             if (left->kind == TS_PRIM && right->kind == TS_PRIM && left->prim.kind != right->prim.kind) {
-                astnode->llvmvalue = LLVMBuildIntCast2(
+                llvmvalue = LLVMBuildIntCast2(
                         c->llvmbuilder,
-                        astnode->llvmvalue,
+                        llvmvalue,
                         cg_get_llvm_type(c, right),
                         // example case: i16 to u64
                         // 1) upcast i16 to i64
@@ -448,22 +888,30 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                                 : typespec_is_signed(left),
                         "");
             } else if (left->kind == TS_PRIM && (right->kind == TS_PTR || right->kind == TS_MULTIPTR)) {
-                astnode->llvmvalue = LLVMBuildIntToPtr(
+                llvmvalue = LLVMBuildIntToPtr(
                         c->llvmbuilder,
-                        astnode->llvmvalue,
+                        llvmvalue,
                         cg_get_llvm_type(c, right),
                         "");
             } else if ((left->kind == TS_PTR || left->kind == TS_MULTIPTR) && right->kind == TS_PRIM) {
-                astnode->llvmvalue = LLVMBuildPtrToInt(
+                llvmvalue = LLVMBuildPtrToInt(
                         c->llvmbuilder,
-                        astnode->llvmvalue,
+                        llvmvalue,
                         cg_get_llvm_type(c, right),
                         "");
             }
         } break;
 
         case ASTNODE_ASSIGN: {
-            if (astnode->assign.left) {
+            if (astnode->assign.left
+                && cg_is_by_ref_call(astnode->assign.right)
+                && cg_is_private_lvalue(astnode->assign.left)) {
+                LLVMValueRef dest = cg_astnode(c, astnode->assign.left, true, NULL, NULL);
+                cg_build_call_into(c, astnode->assign.right, dest);
+            } else if (astnode->assign.left && cg_is_aggregate(astnode->assign.left->typespec)) {
+                LLVMValueRef dest = cg_astnode(c, astnode->assign.left, true, NULL, NULL);
+                cg_build_aggregate_copy(c, dest, astnode->assign.right, astnode->assign.left->typespec, true);
+            } else if (astnode->assign.left) {
                 Typespec* left = astnode->assign.left->typespec;
                 Typespec* right = astnode->assign.right->typespec;
                 Typespec* left_target_type = NULL;
@@ -498,7 +946,6 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
         } break;
 
         case ASTNODE_ARITH_BINOP: {
-            cg_get_llvm_type(c, astnode->typespec);
             if (astnode->arthbin.ptrop) {
                 LLVMValueRef left = cg_astnode(c, astnode->arthbin.left, false, astnode->typespec, NULL);
                 LLVMValueRef right = cg_astnode(
@@ -510,7 +957,7 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                 if (astnode->arthbin.kind == ARITH_BINOP_SUB) {
                     right = LLVMBuildNeg(c->llvmbuilder, right, "");
                 }
-                astnode->llvmvalue = LLVMBuildGEP2(
+                llvmvalue = LLVMBuildGEP2(
                         c->llvmbuilder,
                         cg_get_llvm_type(c, astnode->arthbin.left->typespec->mulptr.child),
                         left,
@@ -537,14 +984,14 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                         break;
                     default: assert(0); break;
                 }
-                astnode->llvmvalue = LLVMBuildBinOp(c->llvmbuilder, op, left, right, "");
+                llvmvalue = LLVMBuildBinOp(c->llvmbuilder, op, left, right, "");
             }
         } break;
 
         case ASTNODE_BOOL_BINOP: {
             LLVMValueRef left = cg_astnode(c, astnode->boolbin.left, false, astnode->typespec, NULL);
-            LLVMBasicBlockRef rhsbb = LLVMAppendBasicBlock(c->current_func->llvmvalue, "land.rhs");
-            LLVMBasicBlockRef endbb = LLVMAppendBasicBlock(c->current_func->llvmvalue, "land.end");
+            LLVMBasicBlockRef rhsbb = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "land.rhs");
+            LLVMBasicBlockRef endbb = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "land.end");
             switch (astnode->boolbin.kind) {
                 case BOOL_BINOP_AND: cg_build_cond_br(c, left, rhsbb, endbb); break;
                 case BOOL_BINOP_OR:  cg_build_cond_br(c, left, endbb, rhsbb); break;
@@ -564,15 +1011,13 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                 case BOOL_BINOP_AND: lhsbr_defaultval = 0; break;
                 case BOOL_BINOP_OR:  lhsbr_defaultval = 1; break;
             }
-            LLVMValueRef lhsbr_defaultllvmvalue = LLVMConstInt(LLVMInt8Type(), lhsbr_defaultval, false);
+            LLVMValueRef lhsbr_defaultllvmvalue = LLVMConstInt(LLVMInt8TypeInContext(c->llvmctx), lhsbr_defaultval, false);
             LLVMAddIncoming(phi, &lhsbr_defaultllvmvalue, &savedbb, 1);
             LLVMAddIncoming(phi, &right, &rhsbb, 1);
-            astnode->llvmvalue = phi;
+            llvmvalue = phi;
         } break;
 
         case ASTNODE_CMP_BINOP: {
-            cg_get_llvm_type(c, astnode->cmpbin.peerres);
-            cg_get_llvm_type(c, astnode->typespec);
             LLVMValueRef left = cg_astnode(c, astnode->cmpbin.left, false, astnode->cmpbin.peerres, NULL);
             LLVMValueRef right = cg_astnode(c, astnode->cmpbin.right, false, astnode->cmpbin.peerres, NULL);
             LLVMIntPredicate op;
@@ -589,7 +1034,7 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                 case CMP_BINOP_LE: signd ? op = LLVMIntSLE : (op = LLVMIntULE); break;
                 case CMP_BINOP_GE: signd ? op = LLVMIntSGE : (op = LLVMIntUGE); break;
             }
-            astnode->llvmvalue = LLVMBuildZExt(
+            llvmvalue = LLVMBuildZExt(
                     c->llvmbuilder,
                     LLVMBuildICmp(
                             c->llvmbuilder,
@@ -597,12 +1042,11 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                             left,
                             right,
                             ""),
-                    LLVMInt8Type(),
+                    LLVMInt8TypeInContext(c->llvmctx),
                     "");
         } break;
 
         case ASTNODE_BITLG_BINOP: {
-            cg_get_llvm_type(c, astnode->typespec);
             LLVMValueRef left = cg_astnode(c, astnode->bitlbin.left, false, astnode->typespec, NULL);
             LLVMValueRef right = cg_astnode(c, astnode->bitlbin.right, false, astnode->typespec, NULL);
             LLVMOpcode op;
@@ -612,11 +1056,10 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                 case BITLG_BINOP_XOR: op = LLVMXor; break;
                 default: assert(0); break;
             }
-            astnode->llvmvalue = LLVMBuildBinOp(c->llvmbuilder, op, left, right, "");
+            llvmvalue = LLVMBuildBinOp(c->llvmbuilder, op, left, right, "");
         } break;
 
         case ASTNODE_BITSH_BINOP: {
-            cg_get_llvm_type(c, astnode->typespec);
             LLVMValueRef left = cg_astnode(c, astnode->bitsbin.left, false, astnode->typespec, NULL);
             // Here, we need to make the right operand type in LLVM equal to left operand type,
             // otherwise LLVM will complain.
@@ -632,29 +1075,32 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                 case BITSH_BINOP_RIGHT: op = typespec_is_signed(astnode->bitsbin.left->typespec) ? LLVMAShr : LLVMLShr; break;
                 default: assert(0); break;
             }
-            astnode->llvmvalue = LLVMBuildBinOp(c->llvmbuilder, op, left, right, "");
+            llvmvalue = LLVMBuildBinOp(c->llvmbuilder, op, left, right, "");
         } break;
 
         case ASTNODE_UNOP: {
-            cg_get_llvm_type(c, astnode->typespec);
             switch (astnode->unop.kind) {
                 case UNOP_NEG: {
                     LLVMValueRef child_llvmvalue = cg_astnode(c, astnode->unop.child, false, astnode->typespec, NULL);
-                    astnode->llvmvalue = LLVMBuildNeg(c->llvmbuilder, child_llvmvalue, "");
+                    llvmvalue = LLVMBuildNeg(c->llvmbuilder, child_llvmvalue, "");
                 } break;
 
                 case UNOP_BITNOT: {
                     LLVMValueRef child_llvmvalue = cg_astnode(c, astnode->unop.child, false, astnode->typespec, NULL);
-                    astnode->llvmvalue = LLVMBuildNot(c->llvmbuilder, child_llvmvalue, "");
+                    llvmvalue = LLVMBuildNot(c->llvmbuilder, child_llvmvalue, "");
                 } break;
 
                 case UNOP_BOOLNOT: {
                     LLVMValueRef child_llvmvalue = cg_astnode(c, astnode->unop.child, false, astnode->typespec, NULL);
-                    astnode->llvmvalue = LLVMBuildXor(c->llvmbuilder, child_llvmvalue, LLVMConstInt(LLVMInt8Type(), 1, false), "");
+                    llvmvalue = LLVMBuildXor(c->llvmbuilder, child_llvmvalue, LLVMConstInt(LLVMInt8TypeInContext(c->llvmctx), 1, false), "");
                 } break;
 
                 case UNOP_ADDR: {
-                    astnode->llvmvalue = cg_astnode(c, astnode->unop.child, true, NULL, NULL);
+                    // The pointer may outlive the statement.
+                    bool pin = c->pin_temp_slots;
+                    c->pin_temp_slots = true;
+                    llvmvalue = cg_astnode(c, astnode->unop.child, true, NULL, NULL);
+                    c->pin_temp_slots = pin;
                 } break;
             }
         } break;
@@ -665,7 +1111,7 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                     assert(astnode->idx.left->typespec->mulptr.child->kind == TS_ARRAY);
                     LLVMValueRef left = cg_astnode(c, astnode->idx.left, false, NULL, NULL);
                     LLVMValueRef index = cg_astnode(c, astnode->idx.idx, false, predef_typespecs.u64_type->ty, NULL);
-                    astnode->llvmvalue = cg_access_array_element(
+                    llvmvalue = cg_access_array_element(
                             c,
                             left,
                             index,
@@ -676,7 +1122,7 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                 case TS_MULTIPTR: {
                     LLVMValueRef left = cg_astnode(c, astnode->idx.left, false, NULL, NULL);
                     LLVMValueRef index = cg_astnode(c, astnode->idx.idx, false, predef_typespecs.u64_type->ty, NULL);
-                    astnode->llvmvalue = LLVMBuildGEP2(
+                    llvmvalue = LLVMBuildGEP2(
                             c->llvmbuilder,
                             cg_get_llvm_type(c, astnode->typespec),
                             left,
@@ -693,7 +1139,7 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                             left,
                             0,
                             "");
-                    astnode->llvmvalue = LLVMBuildGEP2(
+                    llvmvalue = LLVMBuildGEP2(
                             c->llvmbuilder,
                             cg_get_llvm_type(c, astnode->typespec),
                             ptr,
@@ -705,7 +1151,7 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                 case TS_ARRAY: {
                     LLVMValueRef left = cg_astnode(c, astnode->idx.left, true, NULL, NULL);
                     LLVMValueRef index = cg_astnode(c, astnode->idx.idx, false, predef_typespecs.u64_type->ty, NULL);
-                    astnode->llvmvalue = cg_access_array_element(
+                    llvmvalue = cg_access_array_element(
                             c,
                             left,
                             index,
@@ -717,23 +1163,22 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
             }
 
             if (!lvalue) {
-                astnode->llvmvalue = LLVMBuildLoad2(
+                llvmvalue = LLVMBuildLoad2(
                         c->llvmbuilder,
                         cg_get_llvm_type(c, astnode->typespec),
-                        astnode->llvmvalue,
+                        llvmvalue,
                         "");
             }
         } break;
 
         case ASTNODE_DEREF: {
-            cg_get_llvm_type(c, astnode->typespec);
             LLVMValueRef child_llvmvalue = cg_astnode(c, astnode->deref.child, false, NULL, NULL);
             if (lvalue)
-                astnode->llvmvalue = child_llvmvalue;
+                llvmvalue = child_llvmvalue;
             else
-                astnode->llvmvalue = LLVMBuildLoad2(
+                llvmvalue = LLVMBuildLoad2(
                     c->llvmbuilder,
-                    astnode->typespec->llvmtype,
+                    cg_get_llvm_type(c, astnode->typespec),
                     child_llvmvalue,
                     "");
         } break;
@@ -743,13 +1188,12 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
             Typespec* left = is_ptr ? astnode->acc.left->typespec->ptr.child : astnode->acc.left->typespec;
 
             if (left->kind == TS_MODULE) {
-                astnode->typespec->llvmtype = astnode->acc.accessed->typespec->llvmtype;
-                astnode->llvmvalue = astnode->acc.accessed->llvmvalue;
+                llvmvalue = cg_get_decl_llvmvalue(c, astnode->acc.accessed);
                 if (!lvalue && astnode->acc.accessed->kind != ASTNODE_FUNCTION_DEF && astnode->acc.accessed->kind != ASTNODE_EXTERN_FUNCTION) {
-                    astnode->llvmvalue = LLVMBuildLoad2(
+                    llvmvalue = LLVMBuildLoad2(
                             c->llvmbuilder,
-                            astnode->typespec->llvmtype,
-                            astnode->llvmvalue,
+                            cg_get_llvm_type(c, astnode->acc.accessed->typespec),
+                            llvmvalue,
                             "");
                 }
             } else if (left->kind == TS_STRUCT || left->kind == TS_SLICE) {
@@ -767,7 +1211,7 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                     default: assert(0);
                 }
 
-                astnode->llvmvalue = cg_access_struct_field(
+                llvmvalue = cg_access_struct_field(
                         c,
                         left_llvmvalue,
                         cg_get_llvm_type(c, left),
@@ -778,25 +1222,57 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
         } break;
 
         case ASTNODE_EXPRSTMT: {
-            astnode->llvmvalue = cg_astnode(c, astnode->exprstmt, false, NULL, NULL);
+            llvmvalue = cg_astnode(c, astnode->exprstmt, false, NULL, NULL);
         } break;
 
         case ASTNODE_VARIABLE_DECL: {
-            if (astnode->vard.stack && astnode->vard.initializer && !typespec_is_comptime(astnode->typespec)) {
+            LLVMValueRef addr = astnode->vard.stack ? cg_get_decl_llvmvalue(c, astnode) : NULL;
+            if (astnode->vard.stack && astnode->vard.initializer && cg_is_by_ref_call(astnode->vard.initializer)) {
+                // The variable isn't visible to anyone before it's initialized.
+                cg_build_call_into(c, astnode->vard.initializer, addr);
+            } else if (astnode->vard.stack && astnode->vard.initializer && cg_is_aggregate(astnode->typespec)) {
+                cg_build_aggregate_copy(c, addr, astnode->vard.initializer, astnode->typespec, false);
+            } else if (astnode->vard.stack && astnode->vard.initializer && !typespec_is_comptime(astnode->typespec)) {
                 LLVMValueRef initializer_llvmvalue = cg_astnode(c, astnode->vard.initializer, false, astnode->typespec, NULL);
-                LLVMBuildStore(c->llvmbuilder, initializer_llvmvalue, astnode->llvmvalue);
+                LLVMBuildStore(c->llvmbuilder, initializer_llvmvalue, addr);
+            } else if (!astnode->vard.stack) {
+                // Initializers are generated once all struct bodies are known.
+                LLVMValueRef global = cg_get_decl_llvmvalue(c, astnode);
+                LLVMSetGlobalConstant(global, astnode->vard.immutable);
+                if (astnode->vard.initializer) {
+                    LLVMValueRef initializer_llvmvalue = cg_astnode(c, astnode->vard.initializer, false, astnode->typespec, NULL);
+                    LLVMSetInitializer(global, initializer_llvmvalue);
+                } else {
+                    LLVMSetInitializer(global, LLVMConstNull(cg_get_llvm_type(c, astnode->typespec)));
+                }
             }
         } break;
 
         case ASTNODE_EXTERN_VARIABLE: {} break;
 
         case ASTNODE_SCOPED_BLOCK: {
+            AstNode** scoped = NULL;
             bufloop(astnode->blk.stmts, i) {
-                cg_astnode(c, astnode->blk.stmts[i], false, NULL, NULL);
+                AstNode* stmt = astnode->blk.stmts[i];
+                if (cg_needs_lifetime(c, stmt)) {
+                    cg_build_lifetime_marker(c, "llvm.lifetime.start", stmt);
+                    bufpush(scoped, stmt);
+                }
+                usize mark = buflen(c->live_temp_slots);
+                cg_astnode(c, stmt, false, NULL, NULL);
+                cg_release_temp_slots(c, mark);
             }
             if (astnode->blk.val) {
-                astnode->llvmvalue = cg_astnode(c, astnode->blk.val, false, NULL, NULL);
+                llvmvalue = cg_astnode(c, astnode->blk.val, false, NULL, NULL);
+            }
+            // Exits through `return`, `break` or `continue` leave the
+            // locals live, which is only conservative.
+            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(c->llvmbuilder))) {
+                bufrevloop(scoped, i) {
+                    cg_build_lifetime_marker(c, "llvm.lifetime.end", scoped[i]);
+                }
             }
+            buffree(scoped);
         } break;
 
         case ASTNODE_IF_BRANCH: {
@@ -808,8 +1284,7 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
             }
 
             cg_place_builder_at(c, bbinfo.brbodybb);
-            astnode->llvmvalue = cg_astnode(c, astnode->ifbr.body, lvalue, target, NULL);
-            cg_get_llvm_type(c, astnode->typespec);
+            llvmvalue = cg_astnode(c, astnode->ifbr.body, lvalue, target, NULL);
             // Here we compare the branch's type to `noreturn`.
             // If equal: we don't want to generate another branch
             // instruction, because the body of the branch
@@ -824,31 +1299,36 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
         } break;
 
         case ASTNODE_IF: {
-            LLVMBasicBlockRef ifbrbb = LLVMAppendBasicBlock(
-                    c->current_func->llvmvalue,
+            LLVMBasicBlockRef ifbrbb = LLVMAppendBasicBlockInContext(
+                    c->llvmctx,
+                    c->current_llvmfunc,
                     "if.body");
             CondAndBodyBB* elseifbrbb = NULL;
             bufloop(astnode->iff.elseifbr, i) {
                 bufpush(elseifbrbb, (CondAndBodyBB){
-                    LLVMAppendBasicBlock(
-                            c->current_func->llvmvalue,
+                    LLVMAppendBasicBlockInContext(
+                            c->llvmctx,
+                            c->current_llvmfunc,
                             "elseif.cond"),
-                    LLVMAppendBasicBlock(
-                            c->current_func->llvmvalue,
+                    LLVMAppendBasicBlockInContext(
+                            c->llvmctx,
+                            c->current_llvmfunc,
                             "elseif.body")
                 });
             }
             LLVMBasicBlockRef elsebrbb = NULL;
             if (astnode->iff.elsebr) {
-                elsebrbb = LLVMAppendBasicBlock(
-                        c->current_func->llvmvalue,
+                elsebrbb = LLVMAppendBasicBlockInContext(
+                        c->llvmctx,
+                        c->current_llvmfunc,
                         "else.body");
             }
 
             LLVMBasicBlockRef endifexprbb = NULL;
             if (astnode->typespec->kind != TS_noreturn) {
-                endifexprbb = LLVMAppendBasicBlock(
-                        c->current_func->llvmvalue,
+                endifexprbb = LLVMAppendBasicBlockInContext(
+                        c->llvmctx,
+                        c->current_llvmfunc,
                         "if.end");
              }
 
@@ -920,21 +1400,22 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                     LLVMAddIncoming(phi, &elsebrval, &elsebrbb, 1);
                 }
 
-                astnode->llvmvalue = phi;
+                llvmvalue = phi;
             }
         } break;
 
         case ASTNODE_WHILE: {
-            LLVMBasicBlockRef condbb = LLVMAppendBasicBlock(c->current_func->llvmvalue, "while.cond");
-            LLVMBasicBlockRef bodybb = LLVMAppendBasicBlock(c->current_func->llvmvalue, "while.body");
+            LLVMBasicBlockRef condbb = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "while.cond");
+            LLVMBasicBlockRef bodybb = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "while.body");
             LLVMBasicBlockRef elsebb = NULL;
             if (astnode->whloop.elsebody) {
-                elsebb = LLVMAppendBasicBlock(c->current_func->llvmvalue, "while.else");
+                elsebb = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "while.else");
             }
 
-            LLVMBasicBlockRef endwhileexprbb = LLVMAppendBasicBlock(c->current_func->llvmvalue, "while.end");
+            LLVMBasicBlockRef endwhileexprbb = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "while.end");
             bufpush(c->loop_cond_stack, condbb);
             bufpush(c->loop_end_stack, endwhileexprbb);
+            usize breaks_mark = buflen(c->breaks);
 
             LLVMBuildBr(c->llvmbuilder, condbb);
             cg_place_builder_at(c, condbb);
@@ -962,34 +1443,36 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                         cg_get_llvm_type(c, astnode->typespec),
                         "");
 
-                bufloop(astnode->whloop.breaks, i) {
-                    LLVMAddIncoming(phi, &astnode->whloop.breaks[i]->llvmvalue, &astnode->whloop.breaks[i]->brk.llvmbb, 1);
+                for (usize i = breaks_mark; i < buflen(c->breaks); i++) {
+                    LLVMAddIncoming(phi, &c->breaks[i].llvmvalue, &c->breaks[i].llvmbb, 1);
                 }
 
                 if (astnode->whloop.elsebody->typespec->kind != TS_noreturn) {
                     LLVMAddIncoming(phi, &else_llvmvalue, &elsebb, 1);
                 }
-                astnode->llvmvalue = phi;
+                llvmvalue = phi;
             }
 
             bufpop(c->loop_cond_stack);
             bufpop(c->loop_end_stack);
+            while (buflen(c->breaks) > breaks_mark) bufpop(c->breaks);
         } break;
 
         case ASTNODE_CFOR: {
-            LLVMBasicBlockRef condbb = LLVMAppendBasicBlock(c->current_func->llvmvalue, "for.cond");
-            LLVMBasicBlockRef bodybb = LLVMAppendBasicBlock(c->current_func->llvmvalue, "for.body");
-            LLVMBasicBlockRef countbb = LLVMAppendBasicBlock(c->current_func->llvmvalue, "for.count");
+            LLVMBasicBlockRef condbb = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "for.cond");
+            LLVMBasicBlockRef bodybb = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "for.body");
+            LLVMBasicBlockRef countbb = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "for.count");
             LLVMBasicBlockRef elsebb = NULL;
             if (astnode->cfor.elsebody) {
-                elsebb = LLVMAppendBasicBlock(c->current_func->llvmvalue, "for.else");
+                elsebb = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "for.else");
             }
 
-            LLVMBasicBlockRef endforexprbb = LLVMAppendBasicBlock(c->current_func->llvmvalue, "for.end");
+            LLVMBasicBlockRef endforexprbb = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "for.end");
             // We push `countbb` as condition, because when we `continue`, we always want to first
             // increment/decrement count variables, and then execute the condition.
             bufpush(c->loop_cond_stack, countbb);
             bufpush(c->loop_end_stack, endforexprbb);
+            usize breaks_mark = buflen(c->breaks);
 
             bufloop(astnode->cfor.decls, i) {
                 cg_astnode(c, astnode->cfor.decls[i], false, NULL, NULL);
@@ -1033,64 +1516,74 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                         cg_get_llvm_type(c, astnode->typespec),
                         "");
 
-                bufloop(astnode->cfor.breaks, i) {
-                    LLVMAddIncoming(phi, &astnode->cfor.breaks[i]->llvmvalue, &astnode->cfor.breaks[i]->brk.llvmbb, 1);
+                for (usize i = breaks_mark; i < buflen(c->breaks); i++) {
+                    LLVMAddIncoming(phi, &c->breaks[i].llvmvalue, &c->breaks[i].llvmbb, 1);
                 }
 
                 if (astnode->cfor.elsebody->typespec->kind != TS_noreturn) {
                     LLVMAddIncoming(phi, &else_llvmvalue, &elsebb, 1);
                 }
-                astnode->llvmvalue = phi;
+                llvmvalue = phi;
             }
 
             bufpop(c->loop_cond_stack);
             bufpop(c->loop_end_stack);
+            while (buflen(c->breaks) > breaks_mark) bufpop(c->breaks);
         } break;
 
         case ASTNODE_BREAK: {
             // For phi node
             if (astnode->brk.child) {
-                astnode->brk.llvmbb = LLVMAppendBasicBlock(c->current_func->llvmvalue, "break");
-                LLVMBuildBr(c->llvmbuilder, astnode->brk.llvmbb);
-                cg_place_builder_at(c, astnode->brk.llvmbb);
-                astnode->llvmvalue = cg_astnode(c, astnode->brk.child, false, astnode->brk.loopref->typespec, NULL);
+                LLVMBasicBlockRef breakbb = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "break");
+                LLVMBuildBr(c->llvmbuilder, breakbb);
+                cg_place_builder_at(c, breakbb);
+                llvmvalue = cg_astnode(c, astnode->brk.child, false, astnode->brk.loopref->typespec, NULL);
+                bufpush(c->breaks, (CgBreak){ llvmvalue, LLVMGetInsertBlock(c->llvmbuilder) });
             }
             LLVMBuildBr(c->llvmbuilder, c->loop_end_stack[buflen(c->loop_end_stack)-1]);
         } break;
 
         case ASTNODE_CONTINUE: {
-            astnode->llvmvalue = LLVMBuildBr(c->llvmbuilder, c->loop_cond_stack[buflen(c->loop_cond_stack)-1]);
+            llvmvalue = LLVMBuildBr(c->llvmbuilder, c->loop_cond_stack[buflen(c->loop_cond_stack)-1]);
         } break;
 
         case ASTNODE_RETURN: {
-            if (astnode->ret.child) {
-                LLVMValueRef child_llvmvalue = cg_astnode(
+            AstNode* func = astnode->ret.ref;
+            if (astnode->ret.child
+                && astnode->ret.child->kind == ASTNODE_SYMBOL
+                && astnode->ret.child->sym.ref == c->ret_local) {
+                llvmvalue = LLVMBuildRetVoid(c->llvmbuilder);
+            } else if (astnode->ret.child && cg_is_by_ref_call(astnode->ret.child)) {
+                // Our own out param is noalias, so the callee can't see it.
+                cg_build_call_into(
                     c,
                     astnode->ret.child,
-                    false,
-                    astnode->ret.ref->typespec->func.ret_typespec,
-                    NULL);
-                AstNode* func = astnode->ret.ref;
-                if (typespec_is_pass_by_ref(func->typespec->func.ret_typespec)) {
-                    astnode->llvmvalue = LLVMBuildStore(
-                        c->llvmbuilder,
-                        child_llvmvalue,
-                        LLVMGetParam(
-                            func->llvmvalue,
-                            buflen(func->typespec->func.params)));
-                    LLVMBuildRetVoid(c->llvmbuilder);
-                } else {
-                    astnode->llvmvalue = LLVMBuildRet(c->llvmbuilder, child_llvmvalue);
-                }
+                    LLVMGetParam(c->current_llvmfunc, buflen(func->typespec->func.params)));
+                llvmvalue = LLVMBuildRetVoid(c->llvmbuilder);
+            } else if (astnode->ret.child && typespec_is_pass_by_ref(func->typespec->func.ret_typespec)) {
+                cg_build_aggregate_copy(
+                    c,
+                    LLVMGetParam(c->current_llvmfunc, buflen(func->typespec->func.params)),
+                    astnode->ret.child,
+                    func->typespec->func.ret_typespec,
+                    false);
+                llvmvalue = LLVMBuildRetVoid(c->llvmbuilder);
+            } else if (astnode->ret.child) {
+                llvmvalue = LLVMBuildRet(
+                    c->llvmbuilder,
+                    cg_astnode(c, astnode->ret.child, false, func->typespec->func.ret_typespec, NULL));
             } else {
-                astnode->llvmvalue = LLVMBuildRetVoid(c->llvmbuilder);
+                llvmvalue = LLVMBuildRetVoid(c->llvmbuilder);
             }
         } break;
 
         case ASTNODE_FUNCTION_DEF: {
             c->current_func = astnode;
+            c->current_llvmfunc = cg_get_decl_llvmvalue(c, astnode);
+            bufclear(c->temp_slots);
+            bufclear(c->live_temp_slots);
             AstNode* header = astnode->funcdef.header;
-            LLVMBasicBlockRef entry = LLVMAppendBasicBlock(astnode->llvmvalue, "entry");
+            LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(c->llvmctx, c->current_llvmfunc, "entry");
             cg_place_builder_at(c, entry);
 
             AstNode** params = header->funch.params;
@@ -1104,14 +1597,15 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
             LLVMValueRef* param_llvmvalues = NULL;
             if (actual_params_len != 0) {
                 param_llvmvalues = (LLVMValueRef*)malloc(sizeof(LLVMValueRef) * actual_params_len);
-                LLVMGetParams(astnode->llvmvalue, param_llvmvalues);
+                LLVMGetParams(c->current_llvmfunc, param_llvmvalues);
                 for (usize i = 0; i < params_len; i++) {
                     LLVMSetValueName2(
                         param_llvmvalues[i],
                         params[i]->paramd.name,
                         params[i]->paramd.identifier->span.end - params[i]->paramd.identifier->span.start);
-                    params[i]->llvmvalue = LLVMBuildAlloca(c->llvmbuilder, params[i]->typespec->llvmtype, strcat(params[i]->paramd.name, ".addr"));
-                    LLVMBuildStore(c->llvmbuilder, param_llvmvalues[i], params[i]->llvmvalue);
+                    LLVMValueRef addr = LLVMBuildAlloca(c->llvmbuilder, cg_get_llvm_type(c, params[i]->typespec), strcat(params[i]->paramd.name, ".addr"));
+                    LLVMBuildStore(c->llvmbuilder, param_llvmvalues[i], addr);
+                    bufpush(c->param_llvmvalues, addr);
                 }
                 if (ret_by_ref) {
                     LLVMSetValueName2(
@@ -1121,15 +1615,21 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                 }
             }
 
+            // A local that is all the function ever returns lives in
+            // the caller's slot, so returning it copies nothing.
+            c->ret_local = ret_by_ref ? cg_get_ret_local(astnode) : NULL;
             AstNode** locals = astnode->funcdef.locals;
             bufloop(locals, i) {
-                if (!typespec_is_comptime(locals[i]->typespec)) {
-                    cg_get_llvm_type(c, locals[i]->typespec);
-                    locals[i]->llvmvalue = LLVMBuildAlloca(
+                LLVMValueRef addr = NULL;
+                if (locals[i] == c->ret_local) {
+                    addr = param_llvmvalues[params_len];
+                } else if (!typespec_is_comptime(locals[i]->typespec)) {
+                    addr = LLVMBuildAlloca(
                         c->llvmbuilder,
-                        locals[i]->typespec->llvmtype,
+                        cg_get_llvm_type(c, locals[i]->typespec),
                         locals[i]->vard.name);
                 }
+                bufpush(c->local_llvmvalues, addr);
             }
 
             LLVMValueRef body_llvmvalue = cg_astnode(c, astnode->funcdef.body, false, NULL, NULL);
@@ -1144,6 +1644,10 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
                 LLVMBuildUnreachable(c->llvmbuilder);
             }
             c->current_func = NULL;
+            c->current_llvmfunc = NULL;
+            c->ret_local = NULL;
+            bufclear(c->param_llvmvalues);
+            bufclear(c->local_llvmvalues);
         } break;
 
         case ASTNODE_EXTERN_FUNCTION: {} break;
@@ -1154,6 +1658,9 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
         default: assert(0); break;
     }
 
+    // A branch's body is already converted to the target type.
+    if (astnode->kind == ASTNODE_IF_BRANCH) return llvmvalue;
+
     // Integer implicit casting
     if (target
         && typespec_is_sized_integer(target)
@@ -1161,15 +1668,15 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
         && typespec_is_signed(target) == typespec_is_signed(astnode->typespec)) {
         if (typespec_get_bytes(target) > typespec_get_bytes(astnode->typespec)) {
             if (typespec_is_signed(target)) {
-                astnode->llvmvalue = LLVMBuildSExt(
+                llvmvalue = LLVMBuildSExt(
                     c->llvmbuilder,
-                    astnode->llvmvalue,
+                    llvmvalue,
                     cg_get_llvm_type(c, target),
                     "");
             } else {
-                astnode->llvmvalue = LLVMBuildZExt(
+                llvmvalue = LLVMBuildZExt(
                     c->llvmbuilder,
-                    astnode->llvmvalue,
+                    llvmvalue,
                     cg_get_llvm_type(c, target),
                     "");
             }
@@ -1177,151 +1684,873 @@ LLVMValueRef cg_astnode(CgCtx* c, AstNode* astnode, bool lvalue, Typespec* targe
     } else if (target
                && typespec_is_arrptr(astnode->typespec)
                && target->kind == TS_SLICE) {
-        astnode->llvmvalue = LLVMBuildInsertValue(
+        llvmvalue = LLVMBuildInsertValue(
                 c->llvmbuilder,
                 LLVMGetUndef(cg_get_llvm_type(c, target)),
-                astnode->llvmvalue,
+                llvmvalue,
                 0,
                 "");
-        astnode->llvmvalue = LLVMBuildInsertValue(
+        llvmvalue = LLVMBuildInsertValue(
                 c->llvmbuilder,
-                astnode->llvmvalue,
+                llvmvalue,
                 LLVMConstInt(
                     cg_get_llvm_type(c, predef_typespecs.u64_type->ty),
-                    astnode->typespec->ptr.child->array.size->prim.integer.d[0],
+                    bigint_low_u64(&astnode->typespec->ptr.child->array.size->prim.integer),
                     false),
                 1,
                 "");
     }
 
-    return astnode->llvmvalue;
+    return llvmvalue;
+}
+
+typedef enum {
+    // An Aria module before it's linked with the others.
+    PASSES_PRE_LINK,
+    // The linked program.
+    PASSES_POST_LINK,
+    // An IR input compiled into its own object.
+    PASSES_SEPARATE,
+} PassStage;
+
+// Modules are optimized on their own before linking, with the
+// LTO pre-link pipeline, and the linked program gets the LTO
+// pipeline so that inlining can still cross module boundaries.
+static void cg_run_passes(CgCtx* c, PassStage stage) {
+    OptLevel level = c->compile_ctx->opt_level;
+    if (stage == PASSES_POST_LINK && level == OPT_LEVEL_O0) return;
+    bool speed = level == OPT_LEVEL_O2 || level == OPT_LEVEL_O3;
+
+    LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+    LLVMPassBuilderOptionsSetLoopVectorization(options, speed || level == OPT_LEVEL_Os);
+    LLVMPassBuilderOptionsSetSLPVectorization(options, speed || level == OPT_LEVEL_Os);
+    LLVMPassBuilderOptionsSetLoopUnrolling(options, level != OPT_LEVEL_O0);
+    LLVMPassBuilderOptionsSetLoopInterleaving(options, speed);
+    LLVMPassBuilderOptionsSetMergeFunctions(options, level == OPT_LEVEL_Os);
+
+    // -O0 still promotes allocas in Aria modules so that the
+    // generated code isn't all loads and stores.
+    const char* pipeline = NULL;
+    switch (stage) {
+        case PASSES_PRE_LINK: {
+            pipeline = level == OPT_LEVEL_O0
+                ? "default<O0>,function(mem2reg)"
+                : format_string("lto-pre-link<O%s>", opt_level_tostring(level));
+        } break;
+
+        case PASSES_POST_LINK: {
+            // The ThinLTO backend pipeline is the one that expects
+            // imported available_externally functions.
+            bool imported = c->compile_ctx->lto_mode == LTO_THIN && c->compile_ctx->ir_files;
+            pipeline = format_string(imported ? "thinlto<O%s>" : "lto<O%s>", opt_level_tostring(level));
+        } break;
+
+        case PASSES_SEPARATE: {
+            pipeline = format_string("default<O%s>", opt_level_tostring(level));
+        } break;
+    }
+    LLVMErrorRef error = LLVMRunPasses(
+        c->llvmmod,
+        pipeline,
+        c->llvmtargetmachine,
+        options);
+    if (error) {
+        char* errmsg = LLVMGetErrorMessage(error);
+        Msg msg = msg_with_no_span(
+            MSG_ERROR,
+            format_string("[internal] cannot run pass pipeline '%s'", pipeline));
+        msg_addl_thin(&msg, errmsg);
+        msg_emit(c, &msg);
+        LLVMDisposeErrorMessage(errmsg);
+    }
+    LLVMDisposePassBuilderOptions(options);
 }
 
-static bool init_cg(CgCtx* c) {
-    LLVMInitializeAllTargetInfos();
-    LLVMInitializeAllTargets();
-    LLVMInitializeAllTargetMCs();
-    LLVMInitializeAllAsmParsers();
-    LLVMInitializeAllAsmPrinters();
+// Records the optimization level in the object file's
+// `.comment` section, like compilers do with their version.
+static void cg_add_ident(CgCtx* c) {
+    const char* ident = format_string(
+        "aria -O%s",
+        opt_level_tostring(c->compile_ctx->opt_level));
+    LLVMValueRef str = LLVMMDStringInContext(
+        c->llvmctx,
+        ident,
+        strlen(ident));
+    LLVMAddNamedMetadataOperand(
+        c->llvmmod,
+        "llvm.ident",
+        LLVMMDNodeInContext(c->llvmctx, &str, 1));
+}
 
-    if (!c->compile_ctx->target_triple) {
-        c->compile_ctx->target_triple = LLVMGetDefaultTargetTriple();
+// The runtime's entry point, syscall shim and the memory routines
+// LLVM lowers large copies to. These are appended
+// to the module as inline asm, so no start file needs assembling.
+static const char* start_asm_x86_64 =
+    "    .text\n"
+    "    .global _start\n"
+    "_start:\n"
+    "    callq ariamain\n"
+    "    movl %eax, %edi\n"
+    "    callq exit\n"
+    "\n"
+    "    .global _syscall\n"
+    "_syscall:\n"
+    "    movq %rdi, %rax\n"
+    "    movq %rsi, %rdi\n"
+    "    movq %rdx, %rsi\n"
+    "    movq %rcx, %rdx\n"
+    "    movq %r8, %r10\n"
+    "    movq %r9, %r8\n"
+    "    movq 8(%rsp), %r9\n"
+    "    syscall\n"
+    "    ret\n"
+    "\n"
+    "    .weak memcpy\n"
+    "memcpy:\n"
+    "    movq %rdi, %rax\n"
+    "    movq %rdx, %rcx\n"
+    "    rep movsb\n"
+    "    ret\n"
+    "\n"
+    "    .weak memmove\n"
+    "memmove:\n"
+    "    cmpq %rsi, %rdi\n"
+    "    jbe memcpy\n"
+    "    movq %rdi, %rax\n"
+    "    movq %rdx, %rcx\n"
+    "    leaq -1(%rsi,%rdx), %rsi\n"
+    "    leaq -1(%rdi,%rdx), %rdi\n"
+    "    std\n"
+    "    rep movsb\n"
+    "    cld\n"
+    "    ret\n"
+    "\n"
+    "    .weak memset\n"
+    "memset:\n"
+    "    movq %rdi, %r9\n"
+    "    movl %esi, %eax\n"
+    "    movq %rdx, %rcx\n"
+    "    rep stosb\n"
+    "    movq %r9, %rax\n"
+    "    ret\n"
+    "\n"
+    "    .data\n"
+    "    .global SYS_READ\n"
+    "SYS_READ:   .short 0\n"
+    "    .global SYS_WRITE\n"
+    "SYS_WRITE:   .short 1\n"
+    "    .global SYS_EXIT\n"
+    "SYS_EXIT:   .short 60\n"
+    "    .text\n";
+
+static const char* start_asm_aarch64 =
+    "    .text\n"
+    "    .global _start\n"
+    "_start:\n"
+    "    bl ariamain\n"
+    "\n"
+    "    bl exit\n"
+    "\n"
+    "    .global _syscall\n"
+    "_syscall:\n"
+    "    mov x8, x0\n"
+    "    mov x0, x1\n"
+    "    mov x1, x2\n"
+    "    mov x2, x3\n"
+    "    mov x3, x4\n"
+    "    mov x4, x5\n"
+    "    mov x5, x6\n"
+    "    svc #0\n"
+    "    ret\n"
+    "\n"
+    "    .weak memcpy\n"
+    "memcpy:\n"
+    "    mov x3, x0\n"
+    "1:  cbz x2, 2f\n"
+    "    ldrb w4, [x1], #1\n"
+    "    strb w4, [x3], #1\n"
+    "    sub x2, x2, #1\n"
+    "    b 1b\n"
+    "2:  ret\n"
+    "\n"
+    "    .weak memmove\n"
+    "memmove:\n"
+    "    cmp x0, x1\n"
+    "    b.ls memcpy\n"
+    "    add x1, x1, x2\n"
+    "    add x3, x0, x2\n"
+    "1:  cbz x2, 2f\n"
+    "    ldrb w4, [x1, #-1]!\n"
+    "    strb w4, [x3, #-1]!\n"
+    "    sub x2, x2, #1\n"
+    "    b 1b\n"
+    "2:  ret\n"
+    "\n"
+    "    .weak memset\n"
+    "memset:\n"
+    "    mov x3, x0\n"
+    "1:  cbz x2, 2f\n"
+    "    strb w1, [x3], #1\n"
+    "    sub x2, x2, #1\n"
+    "    b 1b\n"
+    "2:  ret\n"
+    "\n"
+    "    .data\n"
+    "    .global SYS_READ\n"
+    "SYS_READ:   .short 63\n"
+    "    .global SYS_WRITE\n"
+    "SYS_WRITE:   .short 64\n"
+    "    .global SYS_EXIT\n"
+    "SYS_EXIT:   .short 93\n"
+    "    .text\n";
+
+static void cg_add_start_code(CgCtx* c) {
+    const char* triple = c->compile_ctx->target_triple;
+    const char* code = NULL;
+    if (strncmp(triple, "x86_64", 6) == 0) {
+        code = start_asm_x86_64;
+    } else if (strncmp(triple, "aarch64", 7) == 0 || strncmp(triple, "arm64", 5) == 0) {
+        code = start_asm_aarch64;
+    } else {
+        Msg msg = msg_with_no_span(
+            MSG_ERROR,
+            format_string("no runtime start code for target '%s'", triple));
+        msg_addl_thin(&msg, "use '--naked' to compile without the runtime");
+        msg_emit(c, &msg);
+        return;
     }
+    LLVMAppendModuleInlineAsm(c->llvmmod, code, strlen(code));
+}
 
+static void cg_emit(CgCtx* c, EmitKind kind, const char* path) {
     char* errors = NULL;
-    bool error = LLVMGetTargetFromTriple(
-        c->compile_ctx->target_triple,
-        &c->llvmtarget,
-        &errors);
+    bool error = false;
+    switch (kind) {
+        case EMIT_OBJ:
+        case EMIT_ASM: {
+            // Machine code generation may change the module, so the
+            // assembly listing is generated from a copy of it.
+            LLVMModuleRef mod = kind == EMIT_ASM ? LLVMCloneModule(c->llvmmod) : c->llvmmod;
+            error = LLVMTargetMachineEmitToFile(
+                c->llvmtargetmachine,
+                mod,
+                (char*)path,
+                kind == EMIT_ASM ? LLVMAssemblyFile : LLVMObjectFile,
+                &errors);
+            if (mod != c->llvmmod) LLVMDisposeModule(mod);
+        } break;
+
+        case EMIT_LLVM_IR: {
+            error = LLVMPrintModuleToFile(c->llvmmod, path, &errors);
+        } break;
+
+        case EMIT_LLVM_BC: {
+            error = LLVMWriteBitcodeToFile(c->llvmmod, path) != 0;
+        } break;
+
+        default: assert(0); break;
+    }
+
     if (error) {
         Msg msg = msg_with_no_span(
             MSG_ERROR,
-            format_string("invalid or unsupported target: '%s'", c->compile_ctx->target_triple));
-        msg_addl_thin(&msg, errors);
+            format_string("cannot emit %s output to '%s'", emit_kind_tostring(kind), path));
+        if (errors) msg_addl_thin(&msg, errors);
         msg_emit(c, &msg);
     }
     LLVMDisposeMessage(errors);
-    errors = NULL;
-    if (error) return true;
-
-    printf(
-            "======== MACHINE INFO ========\n"
-            "target: %s, [%s], %d, %d\n",
-            LLVMGetTargetName(c->llvmtarget),
-            LLVMGetTargetDescription(c->llvmtarget),
-            LLVMTargetHasJIT(c->llvmtarget),
-            LLVMTargetHasTargetMachine(c->llvmtarget));
-    printf("host triple: %s\n", LLVMGetDefaultTargetTriple());
-
-    c->llvmtargetmachine = LLVMCreateTargetMachine(
-            c->llvmtarget,
-            c->compile_ctx->target_triple,
-            "generic",
-            "",
-            LLVMCodeGenLevelDefault,
-            LLVMRelocDefault,
-            LLVMCodeModelDefault);
-    c->llvmtargetdatalayout = LLVMCreateTargetDataLayout(c->llvmtargetmachine);
+}
 
-    return false;
+static void cg_init_module(CgCtx* c, const char* name) {
+    if (!c->llvmctx) c->llvmctx = LLVMContextCreate();
+    c->llvmmod = LLVMModuleCreateWithNameInContext(name, c->llvmctx);
+    LLVMSetTarget(c->llvmmod, c->compile_ctx->target_triple);
+    LLVMSetModuleDataLayout(c->llvmmod, c->compile_ctx->llvmtargetdatalayout);
+    c->llvmptrtype = LLVMPointerTypeInContext(c->llvmctx, 0);
 }
 
-bool cg(CgCtx* c) {
-    if (init_cg(c)) return true;
+// Generates, verifies and optimizes one source module, or takes it
+// from the cache, and leaves its bitcode in `c->llvmbitcode`. Runs on a worker thread, so
+// everything LLVM it touches is private to `c`.
+static void cg_module(CgCtx* c) {
+    Srcfile* srcfile = c->current_mod_ty->mod.srcfile;
+    const char* cache_dir = c->compile_ctx->cache_dir;
+    if (srcfile->cached_bitcode) {
+        c->llvmbitcode = srcfile->cached_bitcode;
+        srcfile->cached_bitcode = NULL;
+        __atomic_fetch_add(&c->compile_ctx->cache_hits, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (cache_dir && srcfile->cache_key) __atomic_fetch_add(&c->compile_ctx->cache_misses, 1, __ATOMIC_RELAXED);
 
-    c->llvmbuilder = LLVMCreateBuilder();
-    c->llvmmod = LLVMModuleCreateWithName("root");
-    c->llvmptrtype = LLVMPointerTypeInContext(LLVMGetGlobalContext(), 0);
+    cg_init_module(c, srcfile->handle.path);
+    c->llvmbuilder = LLVMCreateBuilderInContext(c->llvmctx);
+    c->llvmtargetmachine = compile_create_target_machine(c->compile_ctx);
 
-    bufloop(c->mod_tys, i) {
-        Srcfile* srcfile = c->mod_tys[i]->mod.srcfile;
-        c->current_mod_ty = c->mod_tys[i];
-        bufloop(srcfile->astnodes, j) {
-            cg_top_level_decls_prec1(c, srcfile->astnodes[j]);
+    bufloop(srcfile->astnodes, i) {
+        cg_top_level_decls(c, srcfile->astnodes[i]);
+    }
+    bufloop(srcfile->astnodes, i) {
+        cg_astnode(c, srcfile->astnodes[i], false, NULL, NULL);
+    }
+
+    if (!c->error) {
+        char* errors = NULL;
+        if (LLVMVerifyModule(c->llvmmod, LLVMReturnStatusAction, &errors)) {
+            Msg msg = msg_with_no_span(
+                MSG_ERROR,
+                "[internal] IR generated by the compiler is invalid");
+            msg_addl_thin(&msg, errors);
+            msg_emit(c, &msg);
         }
+        LLVMDisposeMessage(errors);
+    }
+    if (!c->error) cg_run_passes(c, PASSES_PRE_LINK);
+    if (!c->error) {
+        c->llvmbitcode = LLVMWriteBitcodeToMemoryBuffer(c->llvmmod);
+        if (cache_dir && srcfile->cache_key) cache_store(cache_dir, srcfile->cache_key, c->llvmbitcode);
     }
 
+    LLVMDisposeBuilder(c->llvmbuilder);
+    LLVMDisposeModule(c->llvmmod);
+    LLVMDisposeTargetMachine(c->llvmtargetmachine);
+    LLVMContextDispose(c->llvmctx);
+    buffree(c->loop_cond_stack);
+    buffree(c->loop_end_stack);
+}
+
+static void cg_module_work(void* item) {
+    cg_module((CgCtx*)item);
+}
+
+typedef struct {
+    u8* items;
+    usize item_size;
+    usize len;
+    void (*work)(void*);
+    usize next;
+    pthread_mutex_t lock;
+} CgQueue;
+
+static void* cg_worker(void* arg) {
+    CgQueue* queue = (CgQueue*)arg;
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        usize i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (i >= queue->len) break;
+        queue->work(queue->items + i * queue->item_size);
+    }
+    return NULL;
+}
+
+// Calls `work` on each of the `len` items using up to
+// `nthreads` threads, the calling one included.
+static void cg_run_parallel(void* items, usize item_size, usize len, usize nthreads, void (*work)(void*)) {
+    CgQueue queue;
+    queue.items = (u8*)items;
+    queue.item_size = item_size;
+    queue.len = len;
+    queue.work = work;
+    queue.next = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+    if (nthreads > len) nthreads = len;
+
+    pthread_t* threads = NULL;
+    for (usize i = 1; i < nthreads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, cg_worker, &queue) != 0) break;
+        bufpush(threads, thread);
+    }
+    cg_worker(&queue);
+    bufloop(threads, i) {
+        pthread_join(threads[i], NULL);
+    }
+    buffree(threads);
+    pthread_mutex_destroy(&queue.lock);
+}
+
+static usize cg_online_cpus() {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return ncpus > 1 ? (usize)ncpus : 1;
+}
+
+// Moves a worker's module into the root module.
+static void cg_link_module(CgCtx* c, CgCtx* mod) {
+    LLVMModuleRef llvmmod = NULL;
+    if (LLVMParseBitcodeInContext2(c->llvmctx, mod->llvmbitcode, &llvmmod)) {
+        Msg msg = msg_with_no_span(
+            MSG_ERROR,
+            format_string("[internal] cannot read back module '%s'", mod->current_mod_ty->mod.srcfile->handle.path));
+        msg_emit(c, &msg);
+        return;
+    }
+    // Destroys `llvmmod`.
+    if (LLVMLinkModules2(c->llvmmod, llvmmod)) {
+        Msg msg = msg_with_no_span(
+            MSG_ERROR,
+            format_string("[internal] cannot link module '%s'", mod->current_mod_ty->mod.srcfile->handle.path));
+        msg_emit(c, &msg);
+    }
+}
+
+static bool cg_is_only_called(LLVMValueRef fn) {
+    for (LLVMUseRef use = LLVMGetFirstUse(fn); use; use = LLVMGetNextUse(use)) {
+        LLVMValueRef user = LLVMGetUser(use);
+        if (!LLVMIsACallInst(user) || LLVMGetCalledValue(user) != fn) return false;
+    }
+    return true;
+}
+
+// Modules reference each other's declarations by name, so they're
+// generated with external linkage. Once they're linked, everything
+// that isn't exported is made internal, which lets the optimizer
+// drop what's unused and change signatures. Functions that are only
+// called directly use the fast calling convention.
+static void cg_internalize(CgCtx* c) {
     bufloop(c->mod_tys, i) {
         Srcfile* srcfile = c->mod_tys[i]->mod.srcfile;
-        c->current_mod_ty = c->mod_tys[i];
         bufloop(srcfile->astnodes, j) {
-            cg_top_level_decls_prec2(c, srcfile->astnodes[j]);
+            AstNode* astnode = srcfile->astnodes[j];
+            if (astnode->kind == ASTNODE_FUNCTION_DEF && !astnode->funcdef.export) {
+                LLVMValueRef fn = LLVMGetNamedFunction(c->llvmmod, astnode->funcdef.header->funch.mangled_name);
+                if (!fn || LLVMIsDeclaration(fn)) continue;
+                LLVMSetLinkage(fn, LLVMInternalLinkage);
+                if (!cg_is_only_called(fn)) continue;
+                LLVMSetFunctionCallConv(fn, LLVMFastCallConv);
+                for (LLVMUseRef use = LLVMGetFirstUse(fn); use; use = LLVMGetNextUse(use)) {
+                    LLVMSetInstructionCallConv(LLVMGetUser(use), LLVMFastCallConv);
+                }
+            } else if (astnode->kind == ASTNODE_VARIABLE_DECL) {
+                LLVMValueRef global = LLVMGetNamedGlobal(c->llvmmod, astnode->vard.mangled_name);
+                if (global && !LLVMIsDeclaration(global)) LLVMSetLinkage(global, LLVMInternalLinkage);
+            }
         }
     }
+}
 
-    bufloop(c->mod_tys, i) {
-        Srcfile* srcfile = c->mod_tys[i]->mod.srcfile;
-        c->current_mod_ty = c->mod_tys[i];
-        bufloop(srcfile->astnodes, j) {
-            cg_astnode(c, srcfile->astnodes[j], false, NULL, NULL);
+static usize cg_count_instructions(LLVMValueRef fn) {
+    usize count = 0;
+    for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(fn); bb; bb = LLVMGetNextBasicBlock(bb)) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst; inst = LLVMGetNextInstruction(inst)) {
+            count++;
         }
     }
+    return count;
+}
+
+// With a `suffix`, every local symbol is renamed so that it can't
+// clash with ones promoted from other modules.
+static void cg_externalize(LLVMValueRef value, const char* suffix, usize* nunnamed) {
+    LLVMLinkage linkage = LLVMGetLinkage(value);
+    if (linkage != LLVMPrivateLinkage && linkage != LLVMInternalLinkage) return;
+    LLVMSetLinkage(value, LLVMExternalLinkage);
+    LLVMSetVisibility(value, LLVMHiddenVisibility);
+    size_t len;
+    const char* name = LLVMGetValueName2(value, &len);
+    if (len == 0 || suffix) {
+        char* newname = len == 0
+            ? format_string("__aria_local_%lu%s", (*nunnamed)++, suffix ? suffix : "")
+            : format_string("%.*s%s", (int)len, name, suffix);
+        LLVMSetValueName2(value, newname, strlen(newname));
+    }
+}
 
-    printf("\n======= Raw LLVM IR Start =======\n");
-    printf("%s", LLVMPrintModuleToString(c->llvmmod));
-    printf("\n======= Raw LLVM IR End =======\n");
+// A function and the symbols it uses can end up in different
+// objects, so module-local symbols become hidden global ones.
+static void cg_externalize_locals(LLVMModuleRef mod, const char* suffix) {
+    usize nunnamed = 0;
+    for (LLVMValueRef fn = LLVMGetFirstFunction(mod); fn; fn = LLVMGetNextFunction(fn)) {
+        cg_externalize(fn, suffix, &nunnamed);
+    }
+    for (LLVMValueRef global = LLVMGetFirstGlobal(mod); global; global = LLVMGetNextGlobal(global)) {
+        cg_externalize(global, suffix, &nunnamed);
+    }
+}
 
-    bool error = false;
-    char* errors = NULL;
+typedef struct {
+    usize idx;
+    usize size;
+} CgFunctionSize;
+
+static int cg_function_size_cmp(const void* a, const void* b) {
+    usize asize = ((const CgFunctionSize*)a)->size;
+    usize bsize = ((const CgFunctionSize*)b)->size;
+    return asize < bsize ? 1 : (asize > bsize ? -1 : 0);
+}
 
-    error = LLVMVerifyModule(c->llvmmod, LLVMReturnStatusAction, &errors);
-    if (error) {
+// Assigns each function definition, in module order, to one of
+// `nparts` parts so that the parts have about the same number of
+// instructions. Declarations get -1.
+static i32* cg_partition_functions(CgCtx* c, usize nparts) {
+    i32* fn_parts = NULL;
+    CgFunctionSize* sizes = NULL;
+    for (LLVMValueRef fn = LLVMGetFirstFunction(c->llvmmod); fn; fn = LLVMGetNextFunction(fn)) {
+        if (!LLVMIsDeclaration(fn)) {
+            bufpush(sizes, ((CgFunctionSize){ buflen(fn_parts), cg_count_instructions(fn) }));
+        }
+        bufpush(fn_parts, -1);
+    }
+    if (sizes) qsort(sizes, buflen(sizes), sizeof(CgFunctionSize), cg_function_size_cmp);
+
+    // Biggest functions first, each into the lightest part.
+    usize* part_sizes = (usize*)calloc(nparts, sizeof(usize));
+    bufloop(sizes, i) {
+        usize lightest = 0;
+        for (usize j = 1; j < nparts; j++) {
+            if (part_sizes[j] < part_sizes[lightest]) lightest = j;
+        }
+        fn_parts[sizes[i].idx] = (i32)lightest;
+        part_sizes[lightest] += sizes[i].size;
+    }
+    free(part_sizes);
+    buffree(sizes);
+    return fn_parts;
+}
+
+// Replaces a function or variable definition with a declaration
+// of the same symbol.
+static void cg_make_declaration(LLVMModuleRef mod, LLVMValueRef def) {
+    size_t len;
+    const char* name = LLVMGetValueName2(def, &len);
+    char* saved_name = format_string("%.*s", (int)len, name);
+    LLVMValueRef decl = NULL;
+    if (LLVMIsAFunction(def)) {
+        decl = LLVMAddFunction(mod, "", LLVMGlobalGetValueType(def));
+        LLVMSetFunctionCallConv(decl, LLVMGetFunctionCallConv(def));
+    } else {
+        decl = LLVMAddGlobal(mod, LLVMGlobalGetValueType(def), "");
+        LLVMSetGlobalConstant(decl, LLVMIsGlobalConstant(def));
+        LLVMSetThreadLocal(decl, LLVMIsThreadLocal(def));
+        LLVMSetExternallyInitialized(decl, LLVMIsExternallyInitialized(def));
+        LLVMSetAlignment(decl, LLVMGetAlignment(def));
+    }
+    LLVMSetVisibility(decl, LLVMGetVisibility(def));
+    LLVMReplaceAllUsesWith(def, decl);
+    if (LLVMIsAFunction(def)) LLVMDeleteFunction(def);
+    else LLVMDeleteGlobal(def);
+    LLVMSetValueName2(decl, saved_name, len);
+}
+
+typedef struct {
+    CgCtx c;
+    i32 idx;
+    i32* fn_parts;
+    const char* path;
+} CgPart;
+
+// Reads the linked module into a fresh context, keeps only the
+// functions in this part and writes its object. Global variables
+// and the start code are only defined by part 0.
+static void cg_part(CgPart* part) {
+    CgCtx* c = &part->c;
+    c->llvmctx = LLVMContextCreate();
+    c->llvmptrtype = LLVMPointerTypeInContext(c->llvmctx, 0);
+    if (LLVMParseBitcodeInContext2(c->llvmctx, c->llvmbitcode, &c->llvmmod)) {
         Msg msg = msg_with_no_span(
             MSG_ERROR,
-            "[internal] IR generated by the compiler is invalid");
-        msg_addl_thin(&msg, errors);
+            format_string("[internal] cannot read back code generation part %d", part->idx));
         msg_emit(c, &msg);
+        LLVMContextDispose(c->llvmctx);
+        return;
     }
 
-    LLVMDisposeMessage(errors);
-    errors = NULL;
-    if (error) {
-        c->error = true;
-        return c->error;
+    // Collected first because declarations get appended to the lists.
+    LLVMValueRef* defs = NULL;
+    usize i = 0;
+    for (LLVMValueRef fn = LLVMGetFirstFunction(c->llvmmod); fn; fn = LLVMGetNextFunction(fn), i++) {
+        if (part->fn_parts[i] != -1 && part->fn_parts[i] != part->idx) bufpush(defs, fn);
+    }
+    if (part->idx != 0) {
+        for (LLVMValueRef global = LLVMGetFirstGlobal(c->llvmmod); global; global = LLVMGetNextGlobal(global)) {
+            if (!LLVMIsDeclaration(global)) bufpush(defs, global);
+        }
+        LLVMSetModuleInlineAsm2(c->llvmmod, "", 0);
+    }
+    bufloop(defs, j) {
+        cg_make_declaration(c->llvmmod, defs[j]);
     }
+    buffree(defs);
 
-    LLVMRunPasses(c->llvmmod, "mem2reg", c->llvmtargetmachine, LLVMCreatePassBuilderOptions());
+    c->llvmtargetmachine = compile_create_target_machine(c->compile_ctx);
+    cg_emit(c, EMIT_OBJ, part->path);
+    LLVMDisposeTargetMachine(c->llvmtargetmachine);
+    LLVMDisposeModule(c->llvmmod);
+    LLVMContextDispose(c->llvmctx);
+}
 
-    printf("\n======= Optimized LLVM IR Start =======\n");
-    LLVMDumpModule(c->llvmmod);
-    printf("\n======= Optimized LLVM IR End =======\n");
+static void cg_part_work(void* item) {
+    cg_part((CgPart*)item);
+}
 
-    LLVMMemoryBufferRef objbuf = NULL;
-    LLVMTargetMachineEmitToMemoryBuffer(
-        c->llvmtargetmachine,
-        c->llvmmod,
-        LLVMObjectFile,
-        NULL,
-        &objbuf);
-    const char* outpath = c->compile_ctx->naked && c->compile_ctx->outpath ? c->compile_ctx->outpath : "mod.o";
-    if (write_bin_file(outpath, LLVMGetBufferStart(objbuf), LLVMGetBufferSize(objbuf)) != FILEIO_SUCCESS) {
+// Splits the module by function and runs the backend on the parts
+// in parallel. The objects are linked in place of a single one.
+static void cg_emit_parts(CgCtx* c, usize nparts) {
+    CompileCtx* compile_ctx = c->compile_ctx;
+    cg_externalize_locals(c->llvmmod, NULL);
+    i32* fn_parts = cg_partition_functions(c, nparts);
+    c->llvmbitcode = LLVMWriteBitcodeToMemoryBuffer(c->llvmmod);
+
+    CgPart* parts = NULL;
+    for (usize i = 0; i < nparts; i++) {
+        CgPart part;
+        part.c = cg_new_context(c->mod_tys, compile_ctx);
+        part.c.llvmbitcode = c->llvmbitcode;
+        part.idx = (i32)i;
+        part.fn_parts = fn_parts;
+        part.path = compile_new_temp_path(compile_ctx, format_string("mod.%lu.o", i));
+        bufpush(parts, part);
+    }
+    cg_run_parallel(parts, sizeof(CgPart), nparts, nparts, cg_part_work);
+    bufloop(parts, i) {
+        if (parts[i].c.error) c->error = true;
+        bufpush(compile_ctx->part_obj_paths, (char*)parts[i].path);
+    }
+
+    buffree(parts);
+    buffree(fn_parts);
+    LLVMDisposeMemoryBuffer(c->llvmbitcode);
+    c->llvmbitcode = NULL;
+}
+
+static usize cg_count_function_defs(CgCtx* c) {
+    usize count = 0;
+    for (LLVMValueRef fn = LLVMGetFirstFunction(c->llvmmod); fn; fn = LLVMGetNextFunction(fn)) {
+        if (!LLVMIsDeclaration(fn)) count++;
+    }
+    return count;
+}
+
+// Reads a `.ll` or `.bc` file into the context of `c`.
+static LLVMModuleRef cg_read_ir_file(CgCtx* c, const char* path) {
+    LLVMMemoryBufferRef buf = NULL;
+    LLVMModuleRef mod = NULL;
+    char* errors = NULL;
+    bool error = LLVMCreateMemoryBufferWithContentsOfFile(path, &buf, &errors);
+    if (!error) {
+        usize len = strlen(path);
+        if (len >= 3 && strcmp(path+len-3, ".ll") == 0) {
+            // Takes ownership of `buf`.
+            error = LLVMParseIRInContext(c->llvmctx, buf, &mod, &errors);
+        } else {
+            error = LLVMParseBitcodeInContext2(c->llvmctx, buf, &mod);
+            LLVMDisposeMemoryBuffer(buf);
+        }
+    }
+    if (error) {
+        Msg msg = msg_with_no_span(
+            MSG_ERROR,
+            format_string("cannot read LLVM IR file '%s'", path));
+        if (errors) msg_addl_thin(&msg, errors);
+        msg_emit(c, &msg);
+        LLVMDisposeMessage(errors);
+        return NULL;
+    }
+
+    if (LLVMGetTarget(mod)[0] == '\0') {
+        LLVMSetTarget(mod, c->compile_ctx->target_triple);
+        LLVMSetModuleDataLayout(mod, c->compile_ctx->llvmtargetdatalayout);
+    }
+    return mod;
+}
+
+static void cg_link_ir_module(CgCtx* c, LLVMModuleRef mod, const char* path) {
+    // Destroys `mod`.
+    if (LLVMLinkModules2(c->llvmmod, mod)) {
         Msg msg = msg_with_no_span(
             MSG_ERROR,
-            "cannot emit compiled object file");
-        msg_addl_thin(&msg, format_string("filesystem error in opening file '%s' for writing", outpath));
+            format_string("cannot link LLVM IR file '%s'", path));
         msg_emit(c, &msg);
     }
-    LLVMDisposeMemoryBuffer(objbuf);
+}
+
+// The same suffix is used by the importing and the compiling side,
+// so promoted symbols from IR input `idx` agree on their names.
+static char* cg_get_promotion_suffix(usize idx) {
+    return format_string(".aria.ir%lu", idx);
+}
+
+static bool cg_is_importable(LLVMValueRef fn, LLVMValueRef* imports) {
+    if (!fn || !LLVMIsAFunction(fn) || LLVMIsDeclaration(fn)) return false;
+    bufloop(imports, i) {
+        if (imports[i] == fn) return false;
+    }
+    return cg_count_instructions(fn) <= IMPORT_INSTR_LIMIT;
+}
+
+// Keeps the small functions of `mod` that the program calls, and the
+// small ones those call in turn, as available_externally definitions
+// so the optimizer can inline them. Everything else becomes a
+// declaration. The input's own object provides the real definitions.
+static void cg_import_ir_functions(CgCtx* c, LLVMModuleRef mod) {
+    LLVMValueRef* imports = NULL;
+    for (LLVMValueRef fn = LLVMGetFirstFunction(mod); fn; fn = LLVMGetNextFunction(fn)) {
+        size_t len;
+        const char* name = LLVMGetValueName2(fn, &len);
+        LLVMValueRef used = LLVMGetNamedFunction(c->llvmmod, name);
+        if (used && LLVMIsDeclaration(used) && cg_is_importable(fn, imports)) {
+            bufpush(imports, fn);
+        }
+    }
+    for (usize i = 0; i < buflen(imports); i++) {
+        for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(imports[i]); bb; bb = LLVMGetNextBasicBlock(bb)) {
+            for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst; inst = LLVMGetNextInstruction(inst)) {
+                if (!LLVMIsACallInst(inst)) continue;
+                LLVMValueRef callee = LLVMGetCalledValue(inst);
+                if (cg_is_importable(callee, imports)) bufpush(imports, callee);
+            }
+        }
+    }
+
+    LLVMValueRef* defs = NULL;
+    for (LLVMValueRef fn = LLVMGetFirstFunction(mod); fn; fn = LLVMGetNextFunction(fn)) {
+        if (LLVMIsDeclaration(fn)) continue;
+        bool imported = false;
+        bufloop(imports, i) {
+            if (imports[i] == fn) imported = true;
+        }
+        if (imported) {
+            LLVMSetLinkage(fn, LLVMAvailableExternallyLinkage);
+            LLVMSetComdat(fn, NULL);
+        } else {
+            bufpush(defs, fn);
+        }
+    }
+    for (LLVMValueRef global = LLVMGetFirstGlobal(mod); global; global = LLVMGetNextGlobal(global)) {
+        if (!LLVMIsDeclaration(global)) bufpush(defs, global);
+    }
+    bufloop(defs, i) {
+        cg_make_declaration(mod, defs[i]);
+    }
+    buffree(defs);
+    buffree(imports);
+    LLVMSetModuleInlineAsm2(mod, "", 0);
+}
+
+typedef struct {
+    CgCtx c;
+    usize idx;
+    const char* path;
+    const char* objpath;
+} CgIrInput;
+
+// Optimizes and compiles an IR input into its own object.
+static void cg_ir_input(CgIrInput* input) {
+    CgCtx* c = &input->c;
+    c->llvmctx = LLVMContextCreate();
+    c->llvmptrtype = LLVMPointerTypeInContext(c->llvmctx, 0);
+    c->llvmmod = cg_read_ir_file(c, input->path);
+    if (c->llvmmod) {
+        cg_externalize_locals(c->llvmmod, cg_get_promotion_suffix(input->idx));
+        c->llvmtargetmachine = compile_create_target_machine(c->compile_ctx);
+        cg_run_passes(c, PASSES_SEPARATE);
+        if (!c->error) cg_emit(c, EMIT_OBJ, input->objpath);
+        LLVMDisposeTargetMachine(c->llvmtargetmachine);
+        LLVMDisposeModule(c->llvmmod);
+    }
+    LLVMContextDispose(c->llvmctx);
+}
+
+static void cg_ir_input_work(void* item) {
+    cg_ir_input((CgIrInput*)item);
+}
+
+// With full LTO the IR inputs are linked into the program before
+// it's optimized. With thin LTO each input is compiled on its own,
+// in parallel, and only what's worth inlining is imported.
+static void cg_add_ir_inputs(CgCtx* c) {
+    CompileCtx* compile_ctx = c->compile_ctx;
+    if (compile_ctx->lto_mode == LTO_FULL) {
+        bufloop(compile_ctx->ir_files, i) {
+            LLVMModuleRef mod = cg_read_ir_file(c, compile_ctx->ir_files[i]);
+            if (mod) cg_link_ir_module(c, mod, compile_ctx->ir_files[i]);
+        }
+        return;
+    }
+
+    CgIrInput* inputs = NULL;
+    bufloop(compile_ctx->ir_files, i) {
+        LLVMModuleRef mod = cg_read_ir_file(c, compile_ctx->ir_files[i]);
+        if (!mod) continue;
+        cg_externalize_locals(mod, cg_get_promotion_suffix(i));
+        cg_import_ir_functions(c, mod);
+        cg_link_ir_module(c, mod, compile_ctx->ir_files[i]);
+
+        CgIrInput input;
+        input.c = cg_new_context(c->mod_tys, compile_ctx);
+        input.idx = i;
+        input.path = compile_ctx->ir_files[i];
+        input.objpath = compile_new_temp_path(compile_ctx, format_string("ir.%lu.o", i));
+        bufpush(inputs, input);
+    }
+    if (c->error) {
+        buffree(inputs);
+        return;
+    }
+
+    cg_run_parallel(inputs, sizeof(CgIrInput), buflen(inputs), cg_online_cpus(), cg_ir_input_work);
+    bufloop(inputs, i) {
+        if (inputs[i].c.error) c->error = true;
+        bufpush(compile_ctx->other_obj_files, (char*)inputs[i].objpath);
+    }
+    buffree(inputs);
+}
+
+bool cg(CgCtx* c) {
+    cg_init_module(c, "root");
+    c->llvmtargetmachine = c->compile_ctx->llvmtargetmachine;
+
+    CgCtx* mods = NULL;
+    bufloop(c->mod_tys, i) {
+        Srcfile* srcfile = c->mod_tys[i]->mod.srcfile;
+        c->current_mod_ty = c->mod_tys[i];
+        bufloop(srcfile->astnodes, j) {
+            cg_mangle_top_level_decl(c, srcfile->astnodes[j]);
+        }
+
+        CgCtx mod = cg_new_context(c->mod_tys, c->compile_ctx);
+        mod.current_mod_ty = c->mod_tys[i];
+        bufpush(mods, mod);
+    }
+
+    cg_run_parallel(mods, sizeof(CgCtx), buflen(mods), cg_online_cpus(), cg_module_work);
+    bufloop(mods, i) {
+        if (mods[i].error) c->error = true;
+    }
+    bufloop(mods, i) {
+        if (!c->error) cg_link_module(c, &mods[i]);
+        if (mods[i].llvmbitcode) LLVMDisposeMemoryBuffer(mods[i].llvmbitcode);
+    }
+    buffree(mods);
+    if (c->error) return c->error;
+
+    cg_add_ir_inputs(c);
+    if (c->error) return c->error;
+    cg_internalize(c);
+
+    cg_add_ident(c);
+    // A JIT-run program gets the runtime from the compiler.
+    if (!c->compile_ctx->naked && !c->compile_ctx->run) cg_add_start_code(c);
+    if (c->error) return c->error;
+
+    cg_run_passes(c, PASSES_POST_LINK);
+    if (c->error) return c->error;
+
+    // The object file goes last since emitting it changes the module.
+    EmitKind order[] = { EMIT_LLVM_IR, EMIT_LLVM_BC, EMIT_ASM };
+    for (usize i = 0; i < sizeof(order)/sizeof(order[0]); i++) {
+        const char* path = c->compile_ctx->emit_paths[order[i]];
+        if (path) cg_emit(c, order[i], path);
+    }
+    // Only objects that are linked right away can be split.
+    usize nparts = c->compile_ctx->codegen_threads;
+    if (!c->compile_ctx->tmpdir || c->compile_ctx->emit_paths[EMIT_OBJ]) nparts = 1;
+    usize ndefs = cg_count_function_defs(c);
+    if (nparts > ndefs) nparts = ndefs;
+
+    const char* objpath = compile_get_obj_path(c->compile_ctx);
+    if (nparts > 1) cg_emit_parts(c, nparts);
+    else if (objpath) cg_emit(c, EMIT_OBJ, objpath);
 
     return c->error;
 }
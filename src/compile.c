@@ -7,8 +7,12 @@
 #include "parse.h"
 #include "ast_print.h"
 #include "sema.h"
+#include "lint.h"
 #include "cg.h"
 #include "type.h"
+#include "lld_link.h"
+#include "cache.h"
+#include "jit.h"
 
 StringTokenKindTup* keywords = NULL;
 StringBuiltinSymbolKindTup* builtin_symbols = NULL;
@@ -120,7 +124,29 @@ CompileCtx compile_new_context(
     c.outpath = outpath;
     c.target_triple = target_triple;
     c.naked = naked;
+    c.run = false;
+    c.run_exit_code = 0;
+    c.opt_level = OPT_LEVEL_O0;
+    c.cpu = NULL;
+    c.features = NULL;
+    for (usize i = 0; i < EMIT_KIND_COUNT; i++) c.emit_paths[i] = NULL;
+    c.tmpdir = NULL;
+    c.tmp_obj_path = NULL;
+    c.tmp_paths = NULL;
+    c.codegen_threads = 1;
+    c.part_obj_paths = NULL;
+    c.use_cache = false;
+    c.cache_dir = NULL;
+    c.cache_hits = 0;
+    c.cache_misses = 0;
+    c.body_queries = 0;
+    c.body_query_hits = 0;
+    c.llvmtarget = NULL;
+    c.llvmtargetmachine = NULL;
+    c.llvmtargetdatalayout = NULL;
     c.other_obj_files = NULL;
+    c.ir_files = NULL;
+    c.lto_mode = LTO_FULL;
     c.msgs = NULL;
     c.parsing_error = false;
     c.sema_error = false;
@@ -128,11 +154,55 @@ CompileCtx compile_new_context(
     c.compile_error = false;
     c.print_msg_to_stderr = true;
     c.print_ast = false;
+    c.print_stats = false;
+    c.print_cache_stats = false;
+    c.warn_perf = false;
     c.did_msg = false;
     c.next_srcfile_id = 0;
     return c;
 }
 
+const char* opt_level_tostring(OptLevel level) {
+    switch (level) {
+        case OPT_LEVEL_O0: return "0";
+        case OPT_LEVEL_O1: return "1";
+        case OPT_LEVEL_O2: return "2";
+        case OPT_LEVEL_O3: return "3";
+        case OPT_LEVEL_Os: return "s";
+    }
+    assert(0);
+    return NULL;
+}
+
+const char* emit_kind_tostring(EmitKind kind) {
+    switch (kind) {
+        case EMIT_OBJ:     return "obj";
+        case EMIT_ASM:     return "asm";
+        case EMIT_LLVM_IR: return "llvm-ir";
+        case EMIT_LLVM_BC: return "llvm-bc";
+        case EMIT_LINK:    return "link";
+        default: assert(0); break;
+    }
+    return NULL;
+}
+
+const char* compile_get_obj_path(CompileCtx* c) {
+    if (c->emit_paths[EMIT_OBJ]) return c->emit_paths[EMIT_OBJ];
+    return c->tmp_obj_path;
+}
+
+static LLVMCodeGenOptLevel get_llvm_codegen_level(OptLevel level) {
+    switch (level) {
+        case OPT_LEVEL_O0: return LLVMCodeGenLevelNone;
+        case OPT_LEVEL_O1: return LLVMCodeGenLevelLess;
+        case OPT_LEVEL_O2: return LLVMCodeGenLevelDefault;
+        case OPT_LEVEL_O3: return LLVMCodeGenLevelAggressive;
+        case OPT_LEVEL_Os: return LLVMCodeGenLevelDefault;
+    }
+    assert(0);
+    return LLVMCodeGenLevelDefault;
+}
+
 void register_msg(CompileCtx* c, Msg msg) {
     bufpush(c->msgs, msg);
 }
@@ -174,10 +244,17 @@ static bool run_external_program(CompileCtx* c, char* path, char** opts, char* d
         close(errdesc[1]);
         char buf[2];
         int status;
-        wait(&status);
+        waitpid(proc, &status, 0);
 
         int bytesread = read(errdesc[0], buf, sizeof(char));
-        if (bytesread == 0 && WEXITSTATUS(status) != 0) {
+        close(errdesc[0]);
+        if (bytesread == 1) {
+            Msg msg = msg_with_no_span(
+                MSG_ERROR,
+                format_string("%s '%s' not found", desc ? desc : "program", path));
+            msg_emit(c, &msg);
+            return false;
+        } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
             Msg msg = msg_with_no_span(
                 MSG_ERROR,
                 "aborting due to previous error");
@@ -186,20 +263,153 @@ static bool run_external_program(CompileCtx* c, char* path, char** opts, char* d
             return false;
         }
     } else {
-        if (execvp(path, opts) == -1) {
-            close(errdesc[0]);
-            write(errdesc[1], "F", sizeof(char));
-            close(errdesc[1]);
-        }
+        close(errdesc[0]);
+        execvp(path, opts);
+        write(errdesc[1], "F", sizeof(char));
+        _exit(127);
+    }
+    return true;
+}
+
+// Each invocation gets its own directory so that parallel builds
+// in the same directory can't clobber each other's objects.
+static bool create_temp_files(CompileCtx* c) {
+    const char* tmp = getenv("TMPDIR");
+    char* dir = format_string("%s/aria-XXXXXX", tmp && tmp[0] ? tmp : "/tmp");
+    if (!mkdtemp(dir)) {
         Msg msg = msg_with_no_span(
             MSG_ERROR,
-            format_string("%s '%s' not found", desc ? desc : "program", path));
+            format_string("cannot create temporary directory '%s'", dir));
+        msg_addl_thin(&msg, strerror(errno));
         msg_emit(c, &msg);
         return false;
     }
+    c->tmpdir = dir;
+    c->tmp_obj_path = compile_new_temp_path(c, "mod.o");
     return true;
 }
 
+char* compile_new_temp_path(CompileCtx* c, const char* name) {
+    char* path = format_string("%s/%s", c->tmpdir, name);
+    bufpush(c->tmp_paths, path);
+    return path;
+}
+
+static void remove_temp_files(CompileCtx* c) {
+    if (!c->tmpdir) return;
+    bufloop(c->tmp_paths, i) {
+        unlink(c->tmp_paths[i]);
+    }
+    rmdir(c->tmpdir);
+    buffree(c->tmp_paths);
+    c->tmp_paths = NULL;
+    c->tmpdir = NULL;
+    c->tmp_obj_path = NULL;
+}
+
+#ifdef ARIA_LLD
+static bool target_is_elf(const char* triple) {
+    return !strstr(triple, "darwin")
+        && !strstr(triple, "apple")
+        && !strstr(triple, "windows")
+        && !strstr(triple, "mingw");
+}
+#endif
+
+// `ldopts` is a NULL terminated `ld` command line. ELF targets are
+// linked in-process when built with LLD, everything else goes
+// through the system linker.
+static bool link_executable(CompileCtx* c, char** ldopts) {
+#ifdef ARIA_LLD
+    if (target_is_elf(c->target_triple)) {
+        char* errors = NULL;
+        // Skip argv[0] and the NULL terminator.
+        if (lld_link_elf((const char**)ldopts+1, buflen(ldopts)-2, &errors)) return true;
+        Msg msg = msg_with_no_span(MSG_ERROR, "linking failed");
+        if (errors) msg_addl_thin(&msg, errors);
+        msg_emit(c, &msg);
+        free(errors);
+        return false;
+    }
+#endif
+    return run_external_program(c, "ld", ldopts, "linker");
+}
+
+LLVMTargetMachineRef compile_create_target_machine(CompileCtx* c) {
+    return LLVMCreateTargetMachine(
+            c->llvmtarget,
+            c->target_triple,
+            c->cpu,
+            c->features,
+            get_llvm_codegen_level(c->opt_level),
+            LLVMRelocDefault,
+            c->run ? LLVMCodeModelJITDefault : LLVMCodeModelDefault);
+}
+
+// The target is needed by sema to lay out types.
+static bool init_target(CompileCtx* c) {
+    LLVMInitializeAllTargetInfos();
+    LLVMInitializeAllTargets();
+    LLVMInitializeAllTargetMCs();
+    LLVMInitializeAllAsmParsers();
+    LLVMInitializeAllAsmPrinters();
+
+    if (!c->target_triple) {
+        c->target_triple = LLVMGetDefaultTargetTriple();
+    } else if (c->run && strcmp(c->target_triple, LLVMGetDefaultTargetTriple()) != 0) {
+        Msg msg = msg_with_no_span(
+            MSG_ERROR,
+            format_string("cannot run a program compiled for '%s'", c->target_triple));
+        msg_addl_thin(&msg, "'aria run' only targets the host");
+        msg_emit(c, &msg);
+        return true;
+    }
+
+    char* errors = NULL;
+    bool error = LLVMGetTargetFromTriple(
+        c->target_triple,
+        &c->llvmtarget,
+        &errors);
+    if (error) {
+        Msg msg = msg_with_no_span(
+            MSG_ERROR,
+            format_string("invalid or unsupported target: '%s'", c->target_triple));
+        msg_addl_thin(&msg, errors);
+        msg_emit(c, &msg);
+    }
+    LLVMDisposeMessage(errors);
+    errors = NULL;
+    if (error) return true;
+
+    if (!c->cpu) {
+        c->cpu = "generic";
+    } else if (strcmp(c->cpu, "native") == 0) {
+        if (strcmp(c->target_triple, LLVMGetDefaultTargetTriple()) != 0) {
+            Msg msg = msg_with_no_span(
+                MSG_ERROR,
+                format_string("'--mcpu=native' cannot be used when targeting '%s'", c->target_triple));
+            msg_emit(c, &msg);
+            return true;
+        }
+        c->cpu = LLVMGetHostCPUName();
+        char* features = NULL;
+        bufstrexpandpush(features, LLVMGetHostCPUFeatures());
+        if (c->features) {
+            bufpush(features, ',');
+            bufstrexpandpush(features, c->features);
+        }
+        bufpush(features, '\0');
+        c->features = features;
+    }
+    if (!c->features) c->features = "";
+
+    c->llvmtargetmachine = compile_create_target_machine(c);
+    c->llvmtargetdatalayout = LLVMCreateTargetDataLayout(c->llvmtargetmachine);
+    target_layout_init(c->llvmtargetdatalayout);
+
+    return false;
+}
+
 void compile(CompileCtx* c) {
     jmp_buf lex_error_handler_pos;
     jmp_buf parse_error_handler_pos;
@@ -233,78 +443,110 @@ void compile(CompileCtx* c) {
     if (c->print_ast) printf("\n");
 
     if (c->parsing_error) return;
+    if (init_target(c)) return;
+
     SemaCtx* sema_ctxs = NULL;
     for (usize i = 0; i < buflen(c->mod_tys); i++) {
         bufpush(sema_ctxs, sema_new_context(c->mod_tys[i]->mod.srcfile, c));
     }
 
-    c->sema_error = sema(sema_ctxs);
+    c->sema_error = sema_decls(sema_ctxs);
     if (c->sema_error) return;
 
+    // Keys cover the declarations' types, so they're computed
+    // before the bodies, which unchanged modules can skip.
+    if (c->use_cache) {
+        c->cache_dir = cache_get_dir();
+        if (c->cache_dir) {
+            cache_compute_keys(c);
+            bufloop(c->mod_tys, i) {
+                Srcfile* srcfile = c->mod_tys[i]->mod.srcfile;
+                if (!cache_load(c->cache_dir, srcfile->cache_key, &srcfile->cached_bitcode)) {
+                    srcfile->cached_bitcode = NULL;
+                }
+            }
+        }
+    }
+
+    c->sema_error = sema_bodies(sema_ctxs);
+    if (c->print_stats) {
+        u64 total = c->body_queries + c->body_query_hits;
+        fprintf(
+            stderr,
+            "sema: %lu function bodies checked, %lu reused (%.1f%% hit rate)\n",
+            c->body_queries,
+            c->body_query_hits,
+            total ? 100.0 * (double)c->body_query_hits / (double)total : 0.0);
+    }
+    if (c->sema_error) return;
+
+    if (c->warn_perf) {
+        LintCtx lint_ctx = lint_new_context(c->mod_tys, c);
+        lint(&lint_ctx);
+    }
+
+    if (c->lto_mode == LTO_THIN && c->ir_files && !c->emit_paths[EMIT_LINK]) {
+        Msg msg = msg_with_no_span(MSG_ERROR, "'--lto=thin' needs to link an executable");
+        msg_addl_thin(&msg, "IR inputs are compiled to separate objects with thin LTO");
+        msg_emit(c, &msg);
+        return;
+    }
+
+    // Objects that are only needed for linking are kept in a
+    // temporary directory.
+    if (c->emit_paths[EMIT_LINK]) {
+        if (!create_temp_files(c)) return;
+    }
+
+    // The JIT needs the program in a context it can own.
     CgCtx cg_ctx = cg_new_context(c->mod_tys, c);
+    LLVMOrcThreadSafeContextRef tsc = NULL;
+    if (c->run) {
+        tsc = LLVMOrcCreateNewThreadSafeContext();
+        cg_ctx.llvmctx = LLVMOrcThreadSafeContextGetContext(tsc);
+    }
     c->cg_error = cg(&cg_ctx);
-    if (c->cg_error) return;
-
-    if (!c->naked) {
-#if defined(PLATFORM_AMD64)
-        const char* startfile = "_start-x86_64.S";
-#elif defined(PLATFORM_AARCH64)
-        const char* startfile = "_start-aarch64.S";
-#else
-        Msg msg = msg_with_no_span(
-            MSG_ERROR,
-            "unknown platform: no startfile found");
-        _msg_emit(&msg, c);
-        c->cg_error = true;
+    if (c->print_cache_stats) {
+        fprintf(
+            stderr,
+            "cache: %lu hits, %lu misses%s\n",
+            c->cache_hits,
+            c->cache_misses,
+            c->cache_dir ? "" : " (disabled)");
+    }
+    if (c->cg_error) {
+        remove_temp_files(c);
         return;
-#endif
-
-        char* startfile_path = NULL;
-        bufstrexpandpush(startfile_path, g_lib_path);
-        bufstrexpandpush(startfile_path, startfile);
-        bufpush(startfile_path, '\0');
-        if (!file_exists(startfile_path)) {
-            Msg msg = msg_with_no_span(
-                MSG_ERROR,
-                format_string("startfile '%s' not found", startfile_path));
-            msg_emit(c, &msg);
-            return;
-        }
+    }
 
-        char** asopts = NULL;
-        bufpush(asopts, "as");
-        bufpush(asopts, "-g");
-        bufpush(asopts, "-o");
-        bufpush(asopts, "_start.o");
-        bufpush(asopts, startfile_path);
-        bufpush(asopts, NULL);
-        if (!run_external_program(c, "as", asopts, "assembler")) return;
-        buffree(asopts);
+    if (c->run) {
+        jit_run(c, tsc, cg_ctx.llvmmod, &c->run_exit_code);
+        return;
+    }
 
+    const char* objpath = compile_get_obj_path(c);
+    if (c->emit_paths[EMIT_LINK]) {
         char** ldopts = NULL;
         bufpush(ldopts, "ld");
-        if (c->outpath) {
-            bufpush(ldopts, "-o");
-            bufpush(ldopts, (char*)c->outpath);
+        bufpush(ldopts, "-o");
+        bufpush(ldopts, (char*)c->emit_paths[EMIT_LINK]);
+        if (c->part_obj_paths) {
+            bufloop(c->part_obj_paths, i) {
+                bufpush(ldopts, c->part_obj_paths[i]);
+            }
+        } else {
+            bufpush(ldopts, (char*)objpath);
         }
-        bufpush(ldopts, "mod.o");
-        bufpush(ldopts, "_start.o");
         bufloop(c->other_obj_files, i) {
             bufpush(ldopts, c->other_obj_files[i]);
         }
         bufpush(ldopts, NULL);
-        if (!run_external_program(c, "ld", ldopts, "linker")) return;
+        bool linked = link_executable(c, ldopts);
         buffree(ldopts);
-    }
 
-    char** rmopts = NULL;
-    bufpush(rmopts, "rm");
-    bufpush(rmopts, "-f");
-    if (!c->naked || (c->outpath && strcmp(c->outpath, "mod.o") != 0)) bufpush(rmopts, "mod.o");
-    bufpush(rmopts, "_start.o");
-    bufpush(rmopts, NULL);
-    if (!run_external_program(c, "rm", rmopts, NULL)) return;
-    buffree(rmopts);
+        remove_temp_files(c);
+        if (!linked) return;
+    }
 }
 
 struct Typespec* read_srcfile(char* path_wcwd, const char* path_wfile, OptionalSpan span, CompileCtx* compile_ctx) {
@@ -330,6 +572,8 @@ struct Typespec* read_srcfile(char* path_wcwd, const char* path_wfile, OptionalS
             Srcfile* srcfile = malloc(sizeof(Srcfile));
             srcfile->id = compile_ctx->next_srcfile_id++;
             srcfile->handle = efile.handle;
+            srcfile->cache_key = NULL;
+            srcfile->cached_bitcode = NULL;
             Typespec* mod = typespec_module_new(srcfile);
             bufpush(compile_ctx->mod_tys, mod);
             return mod;
@@ -361,14 +605,6 @@ struct Typespec* read_srcfile(char* path_wcwd, const char* path_wfile, OptionalS
 }
 
 void terminate_compilation(CompileCtx* c) {
-    char** rmopts = NULL;
-    bufpush(rmopts, "rm");
-    bufpush(rmopts, "-f");
-    bufpush(rmopts, "mod.o");
-    bufpush(rmopts, "_start.o");
-    bufpush(rmopts, "a.out");
-    bufpush(rmopts, NULL);
-    run_external_program(c, "rm", rmopts, NULL);
-    buffree(rmopts);
+    remove_temp_files(c);
     exit(1);
 }
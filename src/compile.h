@@ -7,6 +7,8 @@
 #include "token.h"
 #include "ast.h"
 
+#include <llvm-c/TargetMachine.h>
+
 typedef struct {
     char* k;
     TokenKind v;
@@ -39,6 +41,11 @@ struct Srcfile {
     File handle;
     Token** tokens;
     struct AstNode** astnodes;
+    // Hex digest naming the module's cache entry, NULL until computed.
+    char* cache_key;
+    // The module's code if it was found in the cache, in which case
+    // its function bodies aren't checked again.
+    LLVMMemoryBufferRef cached_bitcode;
 };
 
 extern StringTokenKindTup* keywords;
@@ -50,13 +57,79 @@ Typespec* get_predef_integer_type(int bytes, bool signd);
 typedef struct CompileCtx CompileCtx;
 typedef struct Srcfile Srcfile;
 
+typedef enum {
+    OPT_LEVEL_O0,
+    OPT_LEVEL_O1,
+    OPT_LEVEL_O2,
+    OPT_LEVEL_O3,
+    OPT_LEVEL_Os,
+} OptLevel;
+
+// Returns the flag spelling of `level` ("0".."3", "s").
+const char* opt_level_tostring(OptLevel level);
+
+typedef enum {
+    EMIT_OBJ,
+    EMIT_ASM,
+    EMIT_LLVM_IR,
+    EMIT_LLVM_BC,
+    EMIT_LINK,
+    EMIT_KIND_COUNT,
+} EmitKind;
+
+// Returns the `--emit` spelling of `kind`.
+const char* emit_kind_tostring(EmitKind kind);
+
+typedef enum {
+    LTO_FULL,
+    LTO_THIN,
+} LtoMode;
+
 struct CompileCtx {
     struct Typespec** mod_tys;
     char** other_obj_files;
+    // `.ll` and `.bc` inputs, combined with the program as
+    // `lto_mode` says.
+    char** ir_files;
+    LtoMode lto_mode;
 
     const char* outpath;
     const char* target_triple;
     bool naked;
+    // `aria run`: the program is compiled in-process and run
+    // instead of being written out, and its exit status is kept
+    // in `run_exit_code`.
+    bool run;
+    int run_exit_code;
+    OptLevel opt_level;
+    // NULL when not given. After init, `cpu` is always set and
+    // "native" is resolved to the host's CPU and features.
+    const char* cpu;
+    const char* features;
+    // Output path for each requested EmitKind, NULL if not requested.
+    const char* emit_paths[EMIT_KIND_COUNT];
+    // Private directory holding the object that is linked when no
+    // object output was asked for. NULL until created.
+    char* tmpdir;
+    char* tmp_obj_path;
+    char** tmp_paths;
+    // Threads the backend is split across when linking.
+    usize codegen_threads;
+    // Objects from split code generation, linked in place
+    // of `tmp_obj_path`.
+    char** part_obj_paths;
+    // Optimized module bitcode is reused from `cache_dir` across
+    // builds when `use_cache` is set and the directory is usable.
+    bool use_cache;
+    const char* cache_dir;
+    u64 cache_hits;
+    u64 cache_misses;
+    u64 body_queries;
+    u64 body_query_hits;
+
+    LLVMTargetRef llvmtarget;
+    LLVMTargetMachineRef llvmtargetmachine;
+    LLVMTargetDataRef llvmtargetdatalayout;
 
     Msg* msgs;
     bool parsing_error;
@@ -66,6 +139,9 @@ struct CompileCtx {
 
     bool print_msg_to_stderr;
     bool print_ast;
+    bool print_stats;
+    bool print_cache_stats;
+    bool warn_perf;
     bool did_msg;
 
     u64 next_srcfile_id;
@@ -79,6 +155,14 @@ CompileCtx compile_new_context(
     bool naked);
 void register_msg(CompileCtx* c, Msg msg);
 void compile(CompileCtx* c);
+// Path the object file is written to, or NULL if none is needed.
+const char* compile_get_obj_path(CompileCtx* c);
+// Target machines aren't thread-safe, so each codegen
+// thread creates its own.
+LLVMTargetMachineRef compile_create_target_machine(CompileCtx* c);
+// Returns a path for `name` in the temporary directory. The file
+// is removed along with the directory.
+char* compile_new_temp_path(CompileCtx* c, const char* name);
 
 struct Typespec* read_srcfile(char* path_wcwd, const char* path_wfile, OptionalSpan span, CompileCtx* compile_ctx);
 void terminate_compilation(CompileCtx* c);
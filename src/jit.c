@@ -0,0 +1,119 @@
+#include "jit.h"
+#include "compile.h"
+#include "buf.h"
+#include "msg.h"
+
+#include <llvm-c/LLJIT.h>
+#include <sys/syscall.h>
+
+// The host's side of the runtime that `_start` and the start code
+// provide in a linked executable. An exit syscall unwinds back to
+// jit_run() instead of ending the compiler.
+static u16 jit_sys_read = SYS_read;
+static u16 jit_sys_write = SYS_write;
+static u16 jit_sys_exit = SYS_exit;
+
+static jmp_buf jit_exit_pos;
+static int jit_exit_code;
+
+static i64 jit_syscall(u64 n, u64 p1, u64 p2, u64 p3, u64 p4, u64 p5, u64 p6) {
+    if (n == SYS_exit || n == SYS_exit_group) {
+        jit_exit_code = (int)(p1 & 0xff);
+        longjmp(jit_exit_pos, 1);
+    }
+    long ret = syscall((long)n, p1, p2, p3, p4, p5, p6);
+    return ret == -1 ? -errno : ret;
+}
+
+static bool jit_check(struct CompileCtx* c, LLVMErrorRef err, const char* what) {
+    if (!err) return false;
+    char* errors = LLVMGetErrorMessage(err);
+    Msg msg = msg_with_no_span(MSG_ERROR, what);
+    msg_addl_thin(&msg, format_string("%s", errors));
+    _msg_emit(&msg, c);
+    c->compile_error = true;
+    LLVMDisposeErrorMessage(errors);
+    return true;
+}
+
+static LLVMJITCSymbolMapPair jit_symbol(LLVMOrcLLJITRef jit, const char* name, void* addr, bool callable) {
+    LLVMJITCSymbolMapPair pair;
+    pair.Name = LLVMOrcLLJITMangleAndIntern(jit, name);
+    pair.Sym.Address = (LLVMOrcExecutorAddress)(uintptr_t)addr;
+    pair.Sym.Flags.GenericFlags = LLVMJITSymbolGenericFlagsExported;
+    if (callable) pair.Sym.Flags.GenericFlags |= LLVMJITSymbolGenericFlagsCallable;
+    pair.Sym.Flags.TargetFlags = 0;
+    return pair;
+}
+
+static bool jit_add_inputs(struct CompileCtx* c, LLVMOrcLLJITRef jit, LLVMOrcThreadSafeContextRef tsc, LLVMModuleRef mod) {
+    LLVMOrcJITDylibRef dylib = LLVMOrcLLJITGetMainJITDylib(jit);
+    LLVMJITCSymbolMapPair runtime[] = {
+        jit_symbol(jit, "_syscall", (void*)jit_syscall, true),
+        jit_symbol(jit, "SYS_READ", &jit_sys_read, false),
+        jit_symbol(jit, "SYS_WRITE", &jit_sys_write, false),
+        jit_symbol(jit, "SYS_EXIT", &jit_sys_exit, false),
+        jit_symbol(jit, "memcpy", (void*)memcpy, true),
+        jit_symbol(jit, "memmove", (void*)memmove, true),
+        jit_symbol(jit, "memset", (void*)memset, true),
+    };
+    LLVMOrcMaterializationUnitRef mu = LLVMOrcAbsoluteSymbols(runtime, sizeof(runtime)/sizeof(runtime[0]));
+    if (jit_check(c, LLVMOrcJITDylibDefine(dylib, mu), "cannot define the runtime symbols")) return false;
+
+    bufloop(c->other_obj_files, i) {
+        LLVMMemoryBufferRef obj = NULL;
+        char* errors = NULL;
+        if (LLVMCreateMemoryBufferWithContentsOfFile(c->other_obj_files[i], &obj, &errors)) {
+            Msg msg = msg_with_no_span(
+                MSG_ERROR,
+                format_string("cannot read object file '%s'", c->other_obj_files[i]));
+            msg_addl_thin(&msg, errors);
+            _msg_emit(&msg, c);
+            c->compile_error = true;
+            LLVMDisposeMessage(errors);
+            return false;
+        }
+        const char* what = format_string("cannot load object file '%s'", c->other_obj_files[i]);
+        if (jit_check(c, LLVMOrcLLJITAddObjectFile(jit, dylib, obj), what)) return false;
+    }
+
+    LLVMOrcThreadSafeModuleRef tsm = LLVMOrcCreateNewThreadSafeModule(mod, tsc);
+    return !jit_check(c, LLVMOrcLLJITAddLLVMIRModule(jit, dylib, tsm), "cannot add the program to the JIT");
+}
+
+bool jit_run(
+        struct CompileCtx* c,
+        LLVMOrcThreadSafeContextRef tsc,
+        LLVMModuleRef mod,
+        int* exit_code) {
+    // Code generation follows `-O` and the target flags. The builder
+    // takes ownership of the target machine.
+    LLVMOrcLLJITBuilderRef builder = LLVMOrcCreateLLJITBuilder();
+    LLVMOrcLLJITBuilderSetJITTargetMachineBuilder(
+        builder,
+        LLVMOrcJITTargetMachineBuilderCreateFromTargetMachine(compile_create_target_machine(c)));
+
+    LLVMOrcLLJITRef jit = NULL;
+    if (jit_check(c, LLVMOrcCreateLLJIT(&jit, builder), "cannot create the JIT")) {
+        LLVMDisposeModule(mod);
+        LLVMOrcDisposeThreadSafeContext(tsc);
+        return true;
+    }
+
+    bool added = jit_add_inputs(c, jit, tsc, mod);
+    // The module holds its own reference to the context.
+    LLVMOrcDisposeThreadSafeContext(tsc);
+
+    LLVMOrcExecutorAddress entry = 0;
+    if (added && !jit_check(c, LLVMOrcLLJITLookup(jit, &entry, "ariamain"), "cannot compile the program")) {
+        i32 (*ariamain)(void) = (i32 (*)(void))(uintptr_t)entry;
+        if (!setjmp(jit_exit_pos)) {
+            *exit_code = ariamain() & 0xff;
+        } else {
+            *exit_code = jit_exit_code;
+        }
+    }
+
+    jit_check(c, LLVMOrcDisposeLLJIT(jit), "cannot tear down the JIT");
+    return c->compile_error;
+}
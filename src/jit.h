@@ -0,0 +1,22 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "core.h"
+
+#include <llvm-c/Core.h>
+#include <llvm-c/Orc.h>
+
+struct CompileCtx;
+
+// Compiles `mod` in-process along with the object inputs and calls
+// its `ariamain`. `mod` must belong to `tsc`'s context; both are
+// consumed. The runtime's `_syscall` and `SYS_*` symbols are provided
+// by the compiler. Returns true on error, otherwise `*exit_code`
+// holds the program's exit status.
+bool jit_run(
+    struct CompileCtx* c,
+    LLVMOrcThreadSafeContextRef tsc,
+    LLVMModuleRef mod,
+    int* exit_code);
+
+#endif
@@ -0,0 +1,442 @@
+#include "lint.h"
+#include "compile.h"
+#include "type.h"
+#include "buf.h"
+#include "msg.h"
+
+// Aggregates bigger than this are reported
+// when passed or returned by value.
+#define LARGE_COPY_BYTES 32
+// How deep calls are followed when looking
+// for per-byte syscalls.
+#define MAX_CALL_DEPTH 2
+
+LintCtx lint_new_context(Typespec** mod_tys, CompileCtx* compile_ctx) {
+    LintCtx l;
+    l.mod_tys = mod_tys;
+    l.compile_ctx = compile_ctx;
+    l.loop_depth = 0;
+    l.addr_taken = NULL;
+    return l;
+}
+
+static inline void msg_emit(LintCtx* l, Msg* msg) {
+    _msg_emit(msg, l->compile_ctx);
+}
+
+// Pushes the statements and expressions directly
+// inside `astnode` to `out`. Typespecs are skipped.
+static void lint_push_children(AstNode* astnode, AstNode*** out) {
+    #define lint_push(child) { if (child) bufpush(*out, (child)); }
+    switch (astnode->kind) {
+        case ASTNODE_ARRAY_LITERAL: {
+            bufloop(astnode->arrayl.elems, i) lint_push(astnode->arrayl.elems[i]);
+        } break;
+
+        case ASTNODE_TUPLE_LITERAL: {
+            bufloop(astnode->tupl.elems, i) lint_push(astnode->tupl.elems[i]);
+        } break;
+
+        case ASTNODE_AGGREGATE_LITERAL: {
+            bufloop(astnode->aggl.fields, i) lint_push(astnode->aggl.fields[i]->field.value);
+        } break;
+
+        case ASTNODE_SCOPED_BLOCK: {
+            bufloop(astnode->blk.stmts, i) lint_push(astnode->blk.stmts[i]);
+            lint_push(astnode->blk.val);
+        } break;
+
+        case ASTNODE_IF_BRANCH: {
+            lint_push(astnode->ifbr.cond);
+            lint_push(astnode->ifbr.body);
+        } break;
+
+        case ASTNODE_IF: {
+            lint_push(astnode->iff.ifbr);
+            bufloop(astnode->iff.elseifbr, i) lint_push(astnode->iff.elseifbr[i]);
+            lint_push(astnode->iff.elsebr);
+        } break;
+
+        case ASTNODE_WHILE: {
+            lint_push(astnode->whloop.cond);
+            lint_push(astnode->whloop.mainbody);
+            lint_push(astnode->whloop.elsebody);
+        } break;
+
+        case ASTNODE_CFOR: {
+            bufloop(astnode->cfor.decls, i) lint_push(astnode->cfor.decls[i]);
+            lint_push(astnode->cfor.cond);
+            bufloop(astnode->cfor.counts, i) lint_push(astnode->cfor.counts[i]);
+            lint_push(astnode->cfor.mainbody);
+            lint_push(astnode->cfor.elsebody);
+        } break;
+
+        case ASTNODE_BREAK: lint_push(astnode->brk.child); break;
+        case ASTNODE_RETURN: lint_push(astnode->ret.child); break;
+
+        case ASTNODE_FUNCTION_CALL: {
+            lint_push(astnode->funcc.callee);
+            bufloop(astnode->funcc.args, i) lint_push(astnode->funcc.args[i]);
+        } break;
+
+        case ASTNODE_ACCESS: lint_push(astnode->acc.left); break;
+        case ASTNODE_UNOP: lint_push(astnode->unop.child); break;
+        case ASTNODE_DEREF: lint_push(astnode->deref.child); break;
+
+        case ASTNODE_INDEX: {
+            lint_push(astnode->idx.left);
+            lint_push(astnode->idx.idx);
+        } break;
+
+        case ASTNODE_ARITH_BINOP: {
+            lint_push(astnode->arthbin.left);
+            lint_push(astnode->arthbin.right);
+        } break;
+
+        case ASTNODE_BOOL_BINOP: {
+            lint_push(astnode->boolbin.left);
+            lint_push(astnode->boolbin.right);
+        } break;
+
+        case ASTNODE_CMP_BINOP: {
+            lint_push(astnode->cmpbin.left);
+            lint_push(astnode->cmpbin.right);
+        } break;
+
+        case ASTNODE_BITLG_BINOP: {
+            lint_push(astnode->bitlbin.left);
+            lint_push(astnode->bitlbin.right);
+        } break;
+
+        case ASTNODE_BITSH_BINOP: {
+            lint_push(astnode->bitsbin.left);
+            lint_push(astnode->bitsbin.right);
+        } break;
+
+        case ASTNODE_ASSIGN: {
+            lint_push(astnode->assign.left);
+            lint_push(astnode->assign.right);
+        } break;
+
+        case ASTNODE_CAST: lint_push(astnode->cast.left); break;
+        case ASTNODE_FUNCTION_DEF: lint_push(astnode->funcdef.body); break;
+        case ASTNODE_VARIABLE_DECL: lint_push(astnode->vard.initializer); break;
+        case ASTNODE_EXPRSTMT: lint_push(astnode->exprstmt); break;
+    }
+    #undef lint_push
+}
+
+static bool lint_contains_call(AstNode* astnode, usize depth, bool (*pred)(AstNode*, usize)) {
+    if (astnode->kind == ASTNODE_FUNCTION_CALL && pred(astnode, depth)) return true;
+
+    AstNode** children = NULL;
+    lint_push_children(astnode, &children);
+    bool found = false;
+    bufloop(children, i) {
+        if (lint_contains_call(children[i], depth, pred)) {
+            found = true;
+            break;
+        }
+    }
+    buffree(children);
+    return found;
+}
+
+static bool lint_is_raw_syscall(AstNode* call, usize depth) {
+    AstNode* ref = call->funcc.ref;
+    return ref
+        && ref->kind == ASTNODE_EXTERN_FUNCTION
+        && strcmp(astnode_get_name(ref), "_syscall") == 0;
+}
+
+// The parameter of the enclosing function that `astnode` passes
+// as the byte count of a `read` or `write` syscall, if any.
+static AstNode* lint_find_count_param(AstNode* astnode) {
+    if (astnode->kind == ASTNODE_FUNCTION_CALL
+        && lint_is_raw_syscall(astnode, 0)
+        && buflen(astnode->funcc.args) > 3) {
+        AstNode* nr = astnode->funcc.args[0];
+        AstNode* count = astnode->funcc.args[3];
+        while (count->kind == ASTNODE_CAST) count = count->cast.left;
+        if (nr->kind == ASTNODE_SYMBOL
+            && nr->sym.ref->kind == ASTNODE_EXTERN_VARIABLE
+            && (strcmp(nr->sym.ref->extvar.name, "SYS_WRITE") == 0
+                || strcmp(nr->sym.ref->extvar.name, "SYS_READ") == 0)
+            && count->kind == ASTNODE_SYMBOL
+            && count->sym.ref->kind == ASTNODE_PARAM_DECL) {
+            return count->sym.ref;
+        }
+    }
+
+    AstNode** children = NULL;
+    lint_push_children(astnode, &children);
+    AstNode* found = NULL;
+    bufloop(children, i) {
+        found = lint_find_count_param(children[i]);
+        if (found) break;
+    }
+    buffree(children);
+    return found;
+}
+
+// A call to a `read` or `write` wrapper with a byte count of 1,
+// or to a function making such a call.
+static bool lint_is_byte_syscall(AstNode* call, usize depth) {
+    AstNode* ref = call->funcc.ref;
+    if (!ref || ref->kind != ASTNODE_FUNCTION_DEF || depth >= MAX_CALL_DEPTH) return false;
+
+    AstNode* param = lint_find_count_param(ref->funcdef.body);
+    if (param && param->paramd.idx < buflen(call->funcc.args)) {
+        AstNode* count = call->funcc.args[param->paramd.idx];
+        if (count->kind == ASTNODE_INTEGER_LITERAL
+            && bigint_fits(&count->intl.val, 1, false)
+            && bigint_low_u64(&count->intl.val) == 1) {
+            return true;
+        }
+    }
+    return lint_contains_call(ref->funcdef.body, depth+1, lint_is_byte_syscall);
+}
+
+static AstNode* lint_get_root_ref(AstNode* astnode) {
+    switch (astnode->kind) {
+        case ASTNODE_SYMBOL: return astnode->sym.ref;
+        case ASTNODE_ACCESS: return lint_get_root_ref(astnode->acc.left);
+        case ASTNODE_INDEX: return lint_get_root_ref(astnode->idx.left);
+        case ASTNODE_DEREF: return lint_get_root_ref(astnode->deref.child);
+    }
+    return NULL;
+}
+
+static bool lint_has_ref(AstNode** refs, AstNode* ref) {
+    bufloop(refs, i) {
+        if (refs[i] == ref) return true;
+    }
+    return false;
+}
+
+// Collects the variables assigned to or whose address is
+// taken in `astnode`. Assignments are skipped if `addr_only`.
+static void lint_collect_modified(AstNode* astnode, bool addr_only, AstNode*** out) {
+    AstNode* ref = NULL;
+    if (astnode->kind == ASTNODE_ASSIGN && !addr_only) {
+        ref = lint_get_root_ref(astnode->assign.left);
+    } else if (astnode->kind == ASTNODE_UNOP && astnode->unop.kind == UNOP_ADDR) {
+        ref = lint_get_root_ref(astnode->unop.child);
+    }
+    if (ref && !lint_has_ref(*out, ref)) bufpush(*out, ref);
+
+    AstNode** children = NULL;
+    lint_push_children(astnode, &children);
+    bufloop(children, i) lint_collect_modified(children[i], addr_only, out);
+    buffree(children);
+}
+
+static bool lint_is_invariant(LintCtx* l, AstNode* astnode, AstNode** modified) {
+    switch (astnode->kind) {
+        case ASTNODE_INTEGER_LITERAL:
+        case ASTNODE_CHAR_LITERAL:
+            return true;
+
+        case ASTNODE_SYMBOL: {
+            AstNode* ref = astnode->sym.ref;
+            if (ref->kind == ASTNODE_VARIABLE_DECL && ref->vard.immutable) return true;
+            if ((ref->kind == ASTNODE_VARIABLE_DECL && ref->vard.stack) || ref->kind == ASTNODE_PARAM_DECL) {
+                return !lint_has_ref(modified, ref) && !lint_has_ref(l->addr_taken, ref);
+            }
+            return false;
+        } break;
+
+        case ASTNODE_ARITH_BINOP: {
+            return !astnode->arthbin.ptrop
+                && lint_is_invariant(l, astnode->arthbin.left, modified)
+                && lint_is_invariant(l, astnode->arthbin.right, modified);
+        } break;
+
+        case ASTNODE_BITLG_BINOP: {
+            return lint_is_invariant(l, astnode->bitlbin.left, modified)
+                && lint_is_invariant(l, astnode->bitlbin.right, modified);
+        } break;
+
+        case ASTNODE_BITSH_BINOP: {
+            return lint_is_invariant(l, astnode->bitsbin.left, modified)
+                && lint_is_invariant(l, astnode->bitsbin.right, modified);
+        } break;
+
+        case ASTNODE_CAST: {
+            return lint_is_invariant(l, astnode->cast.left, modified);
+        } break;
+
+        case ASTNODE_UNOP: {
+            return astnode->unop.kind != UNOP_ADDR
+                && lint_is_invariant(l, astnode->unop.child, modified);
+        } break;
+    }
+    return false;
+}
+
+static void lint_loop_cond(LintCtx* l, AstNode* astnode, AstNode** modified) {
+    switch (astnode->kind) {
+        case ASTNODE_ARITH_BINOP:
+        case ASTNODE_BITLG_BINOP:
+        case ASTNODE_BITSH_BINOP: {
+            if (lint_is_invariant(l, astnode, modified)) {
+                Msg msg = msg_with_span(
+                    MSG_WARNING,
+                    format_string(
+                        "loop condition recomputes invariant `%s` on every iteration (%lu-byte value)",
+                        span_tostring(astnode->span),
+                        typespec_get_bytes(astnode->typespec)),
+                    astnode->span);
+                msg_addl_thin(&msg, "compute it once before the loop");
+                msg_emit(l, &msg);
+                return;
+            }
+        } break;
+    }
+
+    AstNode** children = NULL;
+    lint_push_children(astnode, &children);
+    bufloop(children, i) lint_loop_cond(l, children[i], modified);
+    buffree(children);
+}
+
+// Aggregates are passed and returned as values, so even the ones
+// lowered by reference are copied into a temporary at every call.
+static void lint_large_copy(LintCtx* l, Typespec* ty, const char* what, const char* fix, Span span) {
+    if ((ty->kind == TS_ARRAY || ty->kind == TS_STRUCT)
+        && typespec_get_size(ty) > LARGE_COPY_BYTES) {
+        Msg msg = msg_with_span(
+            MSG_WARNING,
+            format_string(
+                "%s of type `%s` is copied on every call (%lu bytes)",
+                what,
+                typespec_tostring(ty),
+                typespec_get_size(ty)),
+            span);
+        msg_addl_thin(&msg, fix);
+        msg_emit(l, &msg);
+    }
+}
+
+static u64 lint_align_up(u64 n, u64 align) {
+    return (n + align - 1) / align * align;
+}
+
+static void lint_struct_padding(LintCtx* l, AstNode* astnode) {
+    if (astnode->strct.packed) return;
+
+    // Fields sorted by decreasing alignment need the least padding.
+    AstNode** sorted = NULL;
+    bufloop(astnode->strct.fields, i) {
+        AstNode* field = astnode->strct.fields[i];
+        usize pos = buflen(sorted);
+        while (pos > 0 && typespec_get_align(sorted[pos-1]->typespec) < typespec_get_align(field->typespec)) pos--;
+        bufinsert(sorted, pos, field);
+    }
+
+    u64 offset = 0;
+    u64 align = 1;
+    u64 used = 0;
+    bufloop(sorted, i) {
+        u64 field_align = typespec_get_align(sorted[i]->typespec);
+        u64 field_size = typespec_get_size(sorted[i]->typespec);
+        offset = lint_align_up(offset, field_align) + field_size;
+        used += field_size;
+        if (field_align > align) align = field_align;
+    }
+    buffree(sorted);
+
+    u64 size = typespec_get_size(astnode->typespec->ty);
+    u64 best = lint_align_up(offset, align);
+    if (best < size) {
+        Msg msg = msg_with_span(
+            MSG_WARNING,
+            format_string(
+                "struct `%s` wastes %lu of its %lu bytes on padding",
+                astnode->strct.name,
+                size - used,
+                size),
+            astnode->strct.identifier->span);
+        msg_addl_thin(
+            &msg,
+            format_string(
+                "ordering fields by decreasing alignment makes it %lu bytes",
+                best));
+        msg_emit(l, &msg);
+    }
+}
+
+static void lint_astnode(LintCtx* l, AstNode* astnode) {
+    bool loop = false;
+    switch (astnode->kind) {
+        case ASTNODE_STRUCT: {
+            lint_struct_padding(l, astnode);
+        } break;
+
+        case ASTNODE_FUNCTION_DEF: {
+            AstNodeFunctionHeader* header = &astnode->funcdef.header->funch;
+            bufloop(header->params, i) {
+                lint_large_copy(
+                    l,
+                    header->params[i]->typespec,
+                    "parameter",
+                    "pass a pointer instead",
+                    header->params[i]->span);
+            }
+            lint_large_copy(
+                l,
+                astnode->typespec->func.ret_typespec,
+                "return value",
+                "write it through a pointer parameter instead",
+                header->ret_typespec->span);
+
+            // Variables can be modified through their address anywhere.
+            bufclear(l->addr_taken);
+            lint_collect_modified(astnode->funcdef.body, true, &l->addr_taken);
+        } break;
+
+        case ASTNODE_WHILE:
+        case ASTNODE_CFOR: {
+            loop = true;
+            AstNode** modified = NULL;
+            AstNode* cond;
+            if (astnode->kind == ASTNODE_WHILE) {
+                cond = astnode->whloop.cond;
+                lint_collect_modified(astnode->whloop.mainbody, false, &modified);
+            } else {
+                cond = astnode->cfor.cond;
+                bufloop(astnode->cfor.counts, i) lint_collect_modified(astnode->cfor.counts[i], false, &modified);
+                lint_collect_modified(astnode->cfor.mainbody, false, &modified);
+            }
+            if (cond) lint_loop_cond(l, cond, modified);
+            buffree(modified);
+        } break;
+
+        case ASTNODE_FUNCTION_CALL: {
+            if (l->loop_depth != 0 && lint_is_byte_syscall(astnode, 0)) {
+                Msg msg = msg_with_span(
+                    MSG_WARNING,
+                    "call in loop makes a syscall for every byte (1 byte per syscall)",
+                    astnode->span);
+                msg_addl_thin(&msg, "buffer the data and write it at once");
+                msg_emit(l, &msg);
+            }
+        } break;
+    }
+
+    if (loop) l->loop_depth++;
+    AstNode** children = NULL;
+    lint_push_children(astnode, &children);
+    bufloop(children, i) lint_astnode(l, children[i]);
+    buffree(children);
+    if (loop) l->loop_depth--;
+}
+
+void lint(LintCtx* l) {
+    bufloop(l->mod_tys, i) {
+        Srcfile* srcfile = l->mod_tys[i]->mod.srcfile;
+        bufloop(srcfile->astnodes, j) {
+            lint_astnode(l, srcfile->astnodes[j]);
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef LINT_H
+#define LINT_H
+
+#include "core.h"
+#include "ast.h"
+
+struct CompileCtx;
+struct Typespec;
+
+typedef struct {
+    struct Typespec** mod_tys;
+    struct CompileCtx* compile_ctx;
+
+    usize loop_depth;
+    // Locals and params whose address is taken
+    // in the current function.
+    AstNode** addr_taken;
+} LintCtx;
+
+LintCtx lint_new_context(struct Typespec** mod_tys, struct CompileCtx* compile_ctx);
+// Emits performance warnings. Must be run after sema.
+void lint(LintCtx* l);
+
+#endif
@@ -0,0 +1,28 @@
+#include "lld_link.h"
+
+#include <lld/Common/CommonLinkerContext.h>
+#include <lld/Common/Driver.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <string>
+#include <vector>
+
+bool lld_link_elf(const char** args, usize nargs, char** errors) {
+    std::vector<const char*> argv;
+    argv.push_back("ld.lld");
+    argv.insert(argv.end(), args, args + nargs);
+
+    std::string out, err;
+    llvm::raw_string_ostream outstream(out);
+    llvm::raw_string_ostream errstream(err);
+    // Don't let LLD exit() the compiler when linking fails.
+    bool ok = lld::elf::link(argv, outstream, errstream, false, false);
+    // LLD keeps its global state until told otherwise, and refuses to
+    // link again while it's around.
+    lld::CommonLinkerContext::destroy();
+    outstream.flush();
+    errstream.flush();
+
+    *errors = ok ? NULL : strdup(err.c_str());
+    return ok;
+}
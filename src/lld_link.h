@@ -0,0 +1,20 @@
+#ifndef LLD_LINK_H
+#define LLD_LINK_H
+
+#include "core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Links an ELF executable in-process with LLD. `args` are the
+// arguments an `ld.lld` invocation would get, without a NULL
+// terminator. Returns true on success, otherwise `*errors`
+// holds the linker's diagnostics (to be freed with free()).
+bool lld_link_elf(const char** args, usize nargs, char** errors);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -8,6 +8,36 @@
 
 #include <getopt.h>
 
+static bool is_ir_file(const char* path) {
+    usize len = strlen(path);
+    return len >= 3 && (strcmp(path+len-3, ".ll") == 0 || strcmp(path+len-3, ".bc") == 0);
+}
+
+// Emitted files are named after the first source file.
+static const char* emit_get_stem(int argc, char* argv[]) {
+    for (int i = optind; i < argc; i++) {
+        if (strstr(argv[i], ".o") != NULL || is_ir_file(argv[i])) continue;
+        const char* name = strrchr(argv[i], '/');
+        name = name ? name+1 : argv[i];
+        const char* ext = strrchr(name, '.');
+        return format_string("%.*s", (int)(ext ? ext - name : (long)strlen(name)), name);
+    }
+    return "mod";
+}
+
+static const char* emit_get_default_path(const char* stem, EmitKind kind, const char* outpath) {
+    const char* ext = NULL;
+    switch (kind) {
+        case EMIT_OBJ:     ext = ".o"; break;
+        case EMIT_ASM:     ext = ".s"; break;
+        case EMIT_LLVM_IR: ext = ".ll"; break;
+        case EMIT_LLVM_BC: ext = ".bc"; break;
+        case EMIT_LINK:    return outpath ? outpath : "a.out";
+        default: assert(0); break;
+    }
+    return format_string("%s%s", stem, ext);
+}
+
 int main(int argc, char* argv[]) {
     {
         int* buf = NULL;
@@ -30,8 +60,6 @@ int main(int argc, char* argv[]) {
         assert(strcmp(name, "hello, world!") == 0);
     }
 
-    test_bigint();
-
     /* for (usize i = 0; i < buflen(buf); i++) { */
     /*     aria_printf("%d\n", buf[i]); */
     /* } */
@@ -45,21 +73,49 @@ int main(int argc, char* argv[]) {
     init_global_compiler_state();
     init_bigint();
 
+    // `aria run ...` takes the same options as a build.
+    bool run = false;
+    if (argc > 1 && strcmp(argv[1], "run") == 0) {
+        run = true;
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+
     const char* outpath = NULL;
     const char* target_triple = NULL;
     bool naked = false;
+    bool print_stats = false;
+    bool warn_perf = false;
+    OptLevel opt_level = OPT_LEVEL_O0;
+    const char* cpu = NULL;
+    const char* features = NULL;
+    char* emit = NULL;
+    usize codegen_threads = 1;
+    bool use_cache = true;
+    bool print_cache_stats = false;
+    LtoMode lto_mode = LTO_FULL;
 
     struct option options[] = {
         { "output", required_argument, 0, 'o' },
         { "target", required_argument, 0, 't' },
+        { "mcpu",   required_argument, 0, 'c' },
+        { "mattr",  required_argument, 0, 'a' },
+        { "emit",   required_argument, 0, 'e' },
+        { "codegen-threads", required_argument, 0, 'j' },
+        { "lto",    required_argument, 0, 'l' },
         { "naked",  no_argument, 0, 0 },
+        { "stats",  no_argument, 0, 's' },
+        { "cache-stats", no_argument, 0, 'C' },
+        { "no-cache", no_argument, 0, 'N' },
+        { "Wperf",  no_argument, 0, 'W' },
         { "help",   no_argument, 0, 'h' },
         { 0, 0, 0, 0 },
     };
 
     while (true) {
         int longopt_idx = 0;
-        int c = getopt_long(argc, argv, "o:", options, &longopt_idx);
+        int c = getopt_long(argc, argv, "o:O::", options, &longopt_idx);
         if (c == -1) break;
 
         switch (c) {
@@ -71,19 +127,93 @@ int main(int argc, char* argv[]) {
                 target_triple = optarg;
             } break;
 
+            case 'c': {
+                cpu = optarg;
+            } break;
+
+            case 'a': {
+                features = optarg;
+            } break;
+
+            case 'e': {
+                emit = optarg;
+            } break;
+
+            case 'j': {
+                char* end = NULL;
+                unsigned long n = strtoul(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || n == 0) {
+                    fprintf(stderr, "%s: invalid number of codegen threads '%s'\n", argv[0], optarg);
+                    exit(1);
+                }
+                codegen_threads = n;
+            } break;
+
+            case 'l': {
+                if (strcmp(optarg, "full") == 0) lto_mode = LTO_FULL;
+                else if (strcmp(optarg, "thin") == 0) lto_mode = LTO_THIN;
+                else {
+                    fprintf(stderr, "%s: invalid LTO mode '%s'\n", argv[0], optarg);
+                    exit(1);
+                }
+            } break;
+
+            case 'O': {
+                if (!optarg || strcmp(optarg, "2") == 0) opt_level = OPT_LEVEL_O2;
+                else if (strcmp(optarg, "0") == 0) opt_level = OPT_LEVEL_O0;
+                else if (strcmp(optarg, "1") == 0) opt_level = OPT_LEVEL_O1;
+                else if (strcmp(optarg, "3") == 0) opt_level = OPT_LEVEL_O3;
+                else if (strcmp(optarg, "s") == 0) opt_level = OPT_LEVEL_Os;
+                else {
+                    fprintf(stderr, "%s: invalid optimization level '-O%s'\n", argv[0], optarg);
+                    exit(1);
+                }
+            } break;
+
             case 0: {
                 naked = true;
             } break;
 
+            case 's': {
+                print_stats = true;
+            } break;
+
+            case 'W': {
+                warn_perf = true;
+            } break;
+
+            case 'C': {
+                print_cache_stats = true;
+            } break;
+
+            case 'N': {
+                use_cache = false;
+            } break;
+
             case 'h': {
                 printf(
                         "Aria language compiler\n"
                         "Usage: aria [options] file...\n"
+                        "       aria run [options] file...\n"
+                        "Files can be Aria sources, objects, or LLVM IR (.ll, .bc)\n"
+                        "'run' compiles the program in memory and runs it right away\n"
                         "\n"
                         "Options:\n"
                         "  -o, --output=<file>        Place the output into <file>\n"
+                        "  -O<level>                  Optimization level: 0, 1, 2, 3 or s (default 0, -O is -O2)\n"
                         "  --target=<triple>          Specify a target triple for cross compilation\n"
+                        "  --mcpu=<cpu>               Generate code for <cpu>, or 'native' for the host's CPU\n"
+                        "  --mattr=<+a,-b,...>        Enable or disable target features\n"
                         "  --naked                    Emit an object file, instead of an executable, with no runtime\n"
+                        "  --emit=<kind[=file]>,...   Outputs to write: obj, asm, llvm-ir, llvm-bc, link\n"
+                        "                             (defaults to link, or obj with --naked)\n"
+                        "  --codegen-threads=<n>      Split machine code generation across <n> threads when linking\n"
+                        "  --lto=<full|thin>          How .ll and .bc inputs are optimized with the program (default full)\n"
+                        "  --stats                    Print how many function bodies were checked and reused\n"
+                        "  --cache-stats              Print how many modules were reused from the cache\n"
+                        "  --no-cache                 Don't read or write the module cache\n"
+                        "                             (kept in $XDG_CACHE_HOME/aria or ~/.cache/aria)\n"
+                        "  --Wperf                    Warn about avoidable performance costs\n"
                         "  --help                     Display this help and exit\n"
                         "\n"
                         );
@@ -104,6 +234,54 @@ int main(int argc, char* argv[]) {
         target_triple,
         naked);
     compile_ctx.print_ast = false;
+    compile_ctx.print_stats = print_stats;
+    compile_ctx.warn_perf = warn_perf;
+    compile_ctx.opt_level = opt_level;
+    compile_ctx.cpu = cpu;
+    compile_ctx.features = features;
+    compile_ctx.codegen_threads = codegen_threads;
+    compile_ctx.use_cache = use_cache;
+    compile_ctx.print_cache_stats = print_cache_stats;
+    compile_ctx.lto_mode = lto_mode;
+    compile_ctx.run = run;
+
+    if (run) {
+        if (emit || naked || outpath) {
+            Msg msg = msg_with_no_span(MSG_ERROR, "'aria run' doesn't write any output files");
+            msg_addl_thin(&msg, "'-o', '--emit' and '--naked' cannot be used with it");
+            _msg_emit(&msg, &compile_ctx);
+            terminate_compilation(&compile_ctx);
+        }
+    } else if (emit) {
+        const char* stem = emit_get_stem(argc, argv);
+        for (char* kind = strtok(emit, ","); kind; kind = strtok(NULL, ",")) {
+            char* path = strchr(kind, '=');
+            if (path) *path++ = '\0';
+
+            bool found = false;
+            for (usize i = 0; i < EMIT_KIND_COUNT; i++) {
+                if (strcmp(kind, emit_kind_tostring((EmitKind)i)) == 0) {
+                    found = true;
+                    compile_ctx.emit_paths[i] = path ? path : emit_get_default_path(stem, (EmitKind)i, outpath);
+                }
+            }
+            if (!found) {
+                Msg msg = msg_with_no_span(MSG_ERROR, format_string("unknown emit kind '%s'", kind));
+                msg_addl_thin(&msg, "expected one of obj, asm, llvm-ir, llvm-bc, link");
+                _msg_emit(&msg, &compile_ctx);
+                terminate_compilation(&compile_ctx);
+            }
+        }
+        if (naked && compile_ctx.emit_paths[EMIT_LINK]) {
+            Msg msg = msg_with_no_span(MSG_ERROR, "cannot link an executable when '--naked' set");
+            _msg_emit(&msg, &compile_ctx);
+            terminate_compilation(&compile_ctx);
+        }
+    } else if (naked) {
+        compile_ctx.emit_paths[EMIT_OBJ] = outpath ? outpath : "mod.o";
+    } else {
+        compile_ctx.emit_paths[EMIT_LINK] = outpath ? outpath : "a.out";
+    }
 
     if (optind == argc) {
         Msg msg = msg_with_no_span(MSG_ERROR, "no input files");
@@ -120,6 +298,8 @@ int main(int argc, char* argv[]) {
                 terminate_compilation(&compile_ctx);
             }
             bufpush(compile_ctx.other_obj_files, argv[i]);
+        } else if (is_ir_file(argv[i])) {
+            bufpush(compile_ctx.ir_files, argv[i]);
         } else {
             Typespec* mod = read_srcfile(argv[i], NULL, span_none(), &compile_ctx);
             if (!mod) {
@@ -145,4 +325,5 @@ int main(int argc, char* argv[]) {
         || compile_ctx.compile_error) {
         terminate_compilation(&compile_ctx);
     }
+    return compile_ctx.run_exit_code;
 }
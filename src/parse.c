@@ -205,7 +205,8 @@ static AstNode* parse_directive(ParseCtx* p) {
     Token* identifier = expect_identifier(p, "expected directive name");
 
     Token* lparen = expect_lparen(p);
-    AstNode** args = parse_args(p, lparen, TOKEN_RPAREN, true, false);
+    // Directives take types (and field names) as arguments.
+    AstNode** args = parse_args(p, lparen, TOKEN_RPAREN, false, false);
     return astnode_directive_new(start, identifier, args, p->prev);
 }
 
@@ -396,10 +397,10 @@ static AstNode* parse_atom_expr(ParseCtx* p) {
         }
         return left;
 
-    }/* else if (match(p, TOKEN_AT)) {
+    } else if (match(p, TOKEN_AT)) {
         return parse_directive(p);
 
-    }*/ else if (match(p, TOKEN_LBRACE)) {
+    } else if (match(p, TOKEN_LBRACE)) {
         return parse_scoped_block(p);
 
     } else if (match(p, TOKEN_KEYWORD_IF)) {
@@ -539,23 +540,11 @@ static AstNode* parse_atom_expr(ParseCtx* p) {
 
     } else if (match(p, TOKEN_INTEGER_LITERAL)) {
         Token* token = p->prev;
-        bigint val = bigint_new();
-        // TODO: move so that these are only initialized once
-        bigint base = bigint_new_u64(token->base);
-        bigint digit = bigint_new();
-
-        for (usize i = token->base == 10 ? token->span.start : token->span.start+2; i < token->span.end; i++) {
-            char c = token->span.srcfile->handle.contents[i];
-            if (c != '_') {
-                int d = char_to_digit(c);
-                bigint_set_u64(&digit, (u64)d);
-                bigint_mul(&val, &base);
-                bigint_add(&val, &digit);
-            }
-        }
-
-        bigint_free(&digit);
-        bigint_free(&base);
+        usize start = token->base == 10 ? token->span.start : token->span.start+2;
+        bigint val = bigint_from_digits(
+            &token->span.srcfile->handle.contents[start],
+            token->span.end - start,
+            token->base);
         return astnode_integer_literal_new(token, val);
 
     } else if (match(p, TOKEN_STRING_LITERAL)) {
@@ -28,6 +28,7 @@ SemaCtx sema_new_context(
     s.error = false;
     s.current_func = NULL;
     s.loop_stack = NULL;
+    s.sema_ctxs = NULL;
     return s;
 }
 
@@ -615,6 +616,23 @@ static bool sema_check_is_lvalue(SemaCtx* s, AstNode* astnode) {
     return false;
 }
 
+// Marks the variable whose storage `astnode` points into.
+static void sema_mark_addr_taken(AstNode* astnode) {
+    switch (astnode->kind) {
+        case ASTNODE_ACCESS: {
+            if (astnode->acc.left->typespec->kind != TS_PTR) sema_mark_addr_taken(astnode->acc.left);
+        } break;
+
+        case ASTNODE_INDEX: {
+            if (astnode->idx.left->typespec->kind == TS_ARRAY) sema_mark_addr_taken(astnode->idx.left);
+        } break;
+
+        case ASTNODE_SYMBOL: {
+            if (astnode->sym.ref->kind == ASTNODE_VARIABLE_DECL) astnode->sym.ref->vard.addr_taken = true;
+        } break;
+    }
+}
+
 static bool sema_is_lvalue_imm(AstNode* astnode) {
     if ((astnode->kind == ASTNODE_ACCESS && (astnode->acc.left->typespec->kind == TS_PTR))
         || astnode->kind == ASTNODE_DEREF
@@ -672,6 +690,22 @@ static void sema_top_level_decls_prec1(SemaCtx* s, AstNode* astnode) {
         case ASTNODE_IMPORT: {
             sema_scope_declare(s, astnode->import.name, astnode, astnode->import.arg->span);
         } break;
+
+        case ASTNODE_VARIABLE_DECL: {
+            sema_scope_declare(s, astnode->vard.name, astnode, astnode->vard.identifier->span);
+        } break;
+
+        case ASTNODE_EXTERN_VARIABLE: {
+            sema_scope_declare(s, astnode->extvar.name, astnode, astnode->extvar.identifier->span);
+        } break;
+
+        case ASTNODE_FUNCTION_DEF: {
+            sema_scope_declare(s, astnode->funcdef.header->funch.name, astnode, astnode->funcdef.header->funch.identifier->span);
+        } break;
+
+        case ASTNODE_EXTERN_FUNCTION: {
+            sema_scope_declare(s, astnode->extfunc.header->funch.name, astnode, astnode->extfunc.header->funch.identifier->span);
+        } break;
     }
 }
 
@@ -694,6 +728,7 @@ static Typespec* sema_function_header(SemaCtx* s, AstNodeFunctionHeader* header)
     Typespec** params_ty = NULL;
     bufloop(header->params, i) {
         AstNode* param = header->params[i];
+        param->paramd.idx = i;
         Typespec* ty = sema_astnode(s, param->paramd.typespec, NULL);
         if (ty && sema_verify_istype(s, ty, AT_STORAGE_TYPE, param->paramd.typespec->span)) {
             param->typespec = ty->ty;
@@ -708,55 +743,253 @@ static Typespec* sema_function_header(SemaCtx* s, AstNodeFunctionHeader* header)
     return error ? NULL : typespec_func_new(params_ty, ret_ty->ty);
 }
 
-static bool sema_check_astnode_comptime(SemaCtx* s, AstNode* astnode) {
+static bool sema_is_comptime_value(AstNode* astnode) {
+    if (astnode->typespec && typespec_is_unsized_integer(astnode->typespec)) return true;
+
     switch (astnode->kind) {
         case ASTNODE_INTEGER_LITERAL:
         case ASTNODE_STRING_LITERAL:
         case ASTNODE_CHAR_LITERAL:
-        case ASTNODE_BUILTIN_SYMBOL:
             return true;
+        case ASTNODE_BUILTIN_SYMBOL:
+            return astnode->bsym.kind == BS_true || astnode->bsym.kind == BS_false;
         case ASTNODE_ARRAY_LITERAL: {
             bufloop(astnode->arrayl.elems, i) {
-                if (!sema_check_astnode_comptime(s, astnode->arrayl.elems[i])) {
+                if (!sema_is_comptime_value(astnode->arrayl.elems[i])) {
                     return false;
                 }
             }
             return true;
         } break;
-        case ASTNODE_ARITH_BINOP: return sema_check_astnode_comptime(s, astnode->arthbin.left) && sema_check_astnode_comptime(s, astnode->arthbin.right);
-        case ASTNODE_UNOP: {
-            if (astnode->unop.kind == UNOP_NEG) {
-                return sema_check_astnode_comptime(s, astnode->unop.child);
+        case ASTNODE_AGGREGATE_LITERAL: {
+            bufloop(astnode->aggl.fields, i) {
+                if (!sema_is_comptime_value(astnode->aggl.fields[i]->field.value)) {
+                    return false;
+                }
             }
+            return true;
         } break;
-        case ASTNODE_CAST: return sema_check_astnode_comptime(s, astnode->cast.left);
+        // Integer casts are folded, the rest (pointer casts) are
+        // turned into constant expressions by LLVM.
+        case ASTNODE_CAST: return sema_is_comptime_value(astnode->cast.left);
+    }
+    return false;
+}
+
+// Returns the innermost node which stops `astnode` from
+// being folded, or NULL if `astnode` is compile-time known.
+static AstNode* sema_find_runtime_astnode(AstNode* astnode) {
+    if (sema_is_comptime_value(astnode)) return NULL;
 
-        // This case with not return and generate a compile error
-        default: {} break;
+    AstNode* found = NULL;
+    switch (astnode->kind) {
+        case ASTNODE_ARRAY_LITERAL: {
+            bufloop(astnode->arrayl.elems, i) {
+                if ((found = sema_find_runtime_astnode(astnode->arrayl.elems[i]))) break;
+            }
+        } break;
+        case ASTNODE_AGGREGATE_LITERAL: {
+            bufloop(astnode->aggl.fields, i) {
+                if ((found = sema_find_runtime_astnode(astnode->aggl.fields[i]->field.value))) break;
+            }
+        } break;
+        case ASTNODE_ARITH_BINOP: {
+            if (!(found = sema_find_runtime_astnode(astnode->arthbin.left)))
+                found = sema_find_runtime_astnode(astnode->arthbin.right);
+        } break;
+        case ASTNODE_BOOL_BINOP: {
+            if (!(found = sema_find_runtime_astnode(astnode->boolbin.left)))
+                found = sema_find_runtime_astnode(astnode->boolbin.right);
+        } break;
+        case ASTNODE_CMP_BINOP: {
+            if (!(found = sema_find_runtime_astnode(astnode->cmpbin.left)))
+                found = sema_find_runtime_astnode(astnode->cmpbin.right);
+        } break;
+        case ASTNODE_BITLG_BINOP: {
+            if (!(found = sema_find_runtime_astnode(astnode->bitlbin.left)))
+                found = sema_find_runtime_astnode(astnode->bitlbin.right);
+        } break;
+        case ASTNODE_BITSH_BINOP: {
+            if (!(found = sema_find_runtime_astnode(astnode->bitsbin.left)))
+                found = sema_find_runtime_astnode(astnode->bitsbin.right);
+        } break;
+        case ASTNODE_UNOP: {
+            if (astnode->unop.kind != UNOP_ADDR)
+                found = sema_find_runtime_astnode(astnode->unop.child);
+        } break;
     }
+    return found ? found : astnode;
+}
+
+// Must be called after `astnode` has been analyzed
+// (and therefore folded).
+static bool sema_check_astnode_comptime(SemaCtx* s, AstNode* astnode) {
+    AstNode* runtime = sema_find_runtime_astnode(astnode);
+    if (!runtime) return true;
 
     Msg msg = msg_with_span(
         MSG_ERROR,
         "not a compile-time known value",
-        astnode->span);
+        runtime->span);
     msg_emit(s, &msg);
     return false;
 }
 
+static AstNode* sema_get_comptime_astnode(AstNode* astnode);
+static bool sema_get_comptime_integer(AstNode* astnode, bigint* out);
+
+static AstNode* sema_get_comptime_decl_value(AstNode* decl) {
+    if (decl
+        && decl->kind == ASTNODE_VARIABLE_DECL
+        && decl->vard.immutable
+        && decl->vard.initializer
+        && decl->typespec) {
+        return sema_get_comptime_astnode(decl->vard.initializer);
+    }
+    return NULL;
+}
+
+// Returns the literal node that `astnode` evaluates to, looking through
+// immutable variables, field accesses and indexing of constant literals.
+// The node itself is not modified, so that lvalues stay lvalues.
+static AstNode* sema_get_comptime_astnode(AstNode* astnode) {
+    switch (astnode->kind) {
+        case ASTNODE_SYMBOL: {
+            return sema_get_comptime_decl_value(astnode->sym.ref);
+        } break;
+
+        case ASTNODE_ACCESS: {
+            Typespec* left_ty = astnode->acc.left->typespec;
+            if (!left_ty || !astnode->typespec) return NULL;
+            if (left_ty->kind == TS_MODULE) {
+                return sema_get_comptime_decl_value(astnode->acc.accessed);
+            } else if (left_ty->kind == TS_STRUCT) {
+                AstNode* left = sema_get_comptime_astnode(astnode->acc.left);
+                if (left && left->kind == ASTNODE_AGGREGATE_LITERAL) {
+                    bufloop(left->aggl.fields, i) {
+                        if (left->aggl.fields[i]->field.idx == astnode->acc.accessed->field.idx) {
+                            return sema_get_comptime_astnode(left->aggl.fields[i]->field.value);
+                        }
+                    }
+                }
+            }
+            return NULL;
+        } break;
+
+        case ASTNODE_INDEX: {
+            if (!astnode->typespec) return NULL;
+            AstNode* left = sema_get_comptime_astnode(astnode->idx.left);
+            bigint idx;
+            if (left && left->kind == ASTNODE_ARRAY_LITERAL
+                && sema_get_comptime_integer(astnode->idx.idx, &idx)) {
+                bigint len = bigint_new_u64(buflen(left->arrayl.elems));
+                bool inbounds = !idx.neg && bigint_cmp(&idx, &len) < 0;
+                bigint_free(&len);
+                if (inbounds) return sema_get_comptime_astnode(left->arrayl.elems[bigint_low_u64(&idx)]);
+            }
+            return NULL;
+        } break;
+    }
+    return sema_is_comptime_value(astnode) ? astnode : NULL;
+}
+
+// Replaces the elements of a literal with the literals
+// they refer to, so they can be emitted as constants.
+static void sema_inline_comptime_elems(AstNode* astnode) {
+    AstNode* folded;
+    switch (astnode->kind) {
+        case ASTNODE_ARRAY_LITERAL: {
+            bufloop(astnode->arrayl.elems, i) {
+                if ((folded = sema_get_comptime_astnode(astnode->arrayl.elems[i]))) {
+                    astnode->arrayl.elems[i] = folded;
+                }
+                sema_inline_comptime_elems(astnode->arrayl.elems[i]);
+            }
+        } break;
+        case ASTNODE_AGGREGATE_LITERAL: {
+            bufloop(astnode->aggl.fields, i) {
+                AstNode* field = astnode->aggl.fields[i];
+                if ((folded = sema_get_comptime_astnode(field->field.value))) {
+                    field->field.value = folded;
+                }
+                sema_inline_comptime_elems(field->field.value);
+            }
+        } break;
+    }
+}
+
+// Writes the value of a compile-time known integer (or boolean)
+// to `out`. `out` shares storage with the node, so copy before
+// modifying it.
+static bool sema_get_comptime_integer(AstNode* astnode, bigint* out) {
+    if (astnode->typespec && typespec_is_unsized_integer(astnode->typespec)) {
+        *out = astnode->typespec->prim.integer;
+        return true;
+    }
+
+    AstNode* val = sema_get_comptime_astnode(astnode);
+    if (!val) return false;
+    if (val->typespec && typespec_is_unsized_integer(val->typespec)) {
+        *out = val->typespec->prim.integer;
+        return true;
+    }
+
+    switch (val->kind) {
+        case ASTNODE_INTEGER_LITERAL: {
+            *out = val->intl.val;
+            return true;
+        } break;
+
+        case ASTNODE_CHAR_LITERAL: {
+            *out = bigint_new_u64((u8)val->cl.token->c);
+            return true;
+        } break;
+
+        case ASTNODE_BUILTIN_SYMBOL: {
+            if (val->bsym.kind == BS_true || val->bsym.kind == BS_false) {
+                *out = bigint_new_u64(val->bsym.kind == BS_true ? 1 : 0);
+                return true;
+            }
+        } break;
+    }
+    return false;
+}
+
+static bool sema_get_comptime_bool(AstNode* astnode, bool* out) {
+    bigint val;
+    if (astnode->typespec
+        && typespec_is_bool(astnode->typespec)
+        && sema_get_comptime_integer(astnode, &val)) {
+        *out = bigint_cmp(&val, &BIGINT_ZERO) != 0;
+        return true;
+    }
+    return false;
+}
+
 static Typespec* sema_variable_decl(SemaCtx* s, AstNode* astnode) {
     bool error = false;
-    if (astnode->vard.stack) bufpush(s->current_func->funcdef.locals, astnode);
+    if (astnode->vard.stack) {
+        astnode->vard.idx = buflen(s->current_func->funcdef.locals);
+        bufpush(s->current_func->funcdef.locals, astnode);
+    }
 
     if (!sema_check_variable_type(s, astnode, astnode->vard.typespec)) error = true;
     Typespec* initializer = NULL;
     if (astnode->vard.initializer) {
-        if (astnode->vard.stack || sema_check_astnode_comptime(s, astnode->vard.initializer)) {
-            initializer = sema_astnode(s, astnode->vard.initializer, astnode->typespec);
-            if (initializer && sema_verify_isvalue(s, initializer, AT_RUNTIME|AT_COMPTIME, astnode->vard.initializer->span)) {
-            } else error = true;
+        initializer = sema_astnode(s, astnode->vard.initializer, astnode->typespec);
+        if (initializer && sema_verify_isvalue(s, initializer, AT_RUNTIME|AT_COMPTIME, astnode->vard.initializer->span)) {
+            if (!astnode->vard.stack) {
+                // Globals referring to other constants are
+                // initialized with the referred literal.
+                AstNode* folded = sema_get_comptime_astnode(astnode->vard.initializer);
+                if (folded) astnode->vard.initializer = folded;
+                sema_inline_comptime_elems(astnode->vard.initializer);
+                if (!sema_check_astnode_comptime(s, astnode->vard.initializer)) error = true;
+            }
         } else error = true;
     }
-    if (!sema_declare_variable(s, astnode, astnode->vard.name, astnode->vard.identifier)) error = true;
+    // Globals are declared before any of them are analyzed.
+    if (astnode->vard.stack && !sema_declare_variable(s, astnode, astnode->vard.name, astnode->vard.identifier)) error = true;
 
     if (error) return NULL;
     error = false;
@@ -784,15 +1017,34 @@ static Typespec* sema_variable_decl(SemaCtx* s, AstNode* astnode) {
     return error ? NULL : astnode->typespec;
 }
 
-static void sema_top_level_decls_prec2(SemaCtx* s, AstNode* astnode) {
+static bool sema_is_query_decl(AstNode* astnode) {
+    switch (astnode->kind) {
+        case ASTNODE_VARIABLE_DECL: return !astnode->vard.stack;
+        case ASTNODE_EXTERN_VARIABLE:
+        case ASTNODE_FUNCTION_DEF:
+        case ASTNODE_EXTERN_FUNCTION:
+        case ASTNODE_STRUCT: return true;
+        default: return false;
+    }
+}
+
+static SemaCtx* sema_get_decl_ctx(SemaCtx* s, AstNode* decl) {
+    bufloop(s->sema_ctxs, i) {
+        if (s->sema_ctxs[i].srcfile == decl->span.srcfile) return &s->sema_ctxs[i];
+    }
+    return s;
+}
+
+// Returns true on error.
+static bool sema_resolve_top_level_decl(SemaCtx* s, AstNode* astnode) {
+    bool error = false;
     switch (astnode->kind) {
         case ASTNODE_VARIABLE_DECL: {
-            sema_variable_decl(s, astnode);
+            if (!sema_variable_decl(s, astnode)) error = true;
         } break;
 
         case ASTNODE_EXTERN_VARIABLE: {
-            sema_check_variable_type(s, astnode, astnode->extvar.typespec);
-            sema_declare_variable(s, astnode, astnode->extvar.name, astnode->extvar.identifier);
+            if (!sema_check_variable_type(s, astnode, astnode->extvar.typespec)) error = true;
         } break;
 
         case ASTNODE_FUNCTION_DEF: {
@@ -800,8 +1052,7 @@ static void sema_top_level_decls_prec2(SemaCtx* s, AstNode* astnode) {
             if (ty) {
                 astnode->funcdef.header->typespec = ty;
                 astnode->typespec = ty;
-            }
-            sema_scope_declare(s, astnode->funcdef.header->funch.name, astnode, astnode->funcdef.header->funch.identifier->span);
+            } else error = true;
         } break;
 
         case ASTNODE_EXTERN_FUNCTION: {
@@ -809,12 +1060,10 @@ static void sema_top_level_decls_prec2(SemaCtx* s, AstNode* astnode) {
             if (ty) {
                 astnode->extfunc.header->typespec = ty;
                 astnode->typespec = ty;
-            }
-            sema_scope_declare(s, astnode->extfunc.header->funch.name, astnode, astnode->extfunc.header->funch.identifier->span);
+            } else error = true;
         } break;
 
         case ASTNODE_STRUCT: {
-            bool error = false;
             bufloop(astnode->strct.fields, i) {
                 AstNode* fieldnode = astnode->strct.fields[i];
                 fieldnode->field.idx = i;
@@ -840,6 +1089,54 @@ static void sema_top_level_decls_prec2(SemaCtx* s, AstNode* astnode) {
             }
         } break;
     }
+    return error;
+}
+
+// Resolves a top-level declaration (a global's type and
+// initializer, a function's signature or a struct's fields)
+// when it is first needed, so declarations can be referred to
+// regardless of their order.
+static bool sema_query_decl(SemaCtx* s, AstNode* decl, Span use) {
+    switch (decl->query) {
+        case QUERY_DONE:
+        case QUERY_FAILED: {
+            return decl->query == QUERY_DONE;
+        } break;
+
+        case QUERY_RUNNING: {
+            Msg msg = msg_with_span(
+                MSG_ERROR,
+                format_string("`%s` depends on itself", astnode_get_name(decl)),
+                use);
+            msg_emit(s, &msg);
+            return false;
+        } break;
+
+        default: break;
+    }
+
+    SemaCtx* d = sema_get_decl_ctx(s, decl);
+    decl->query = QUERY_RUNNING;
+
+    // Only the global scope of the declaring module is visible.
+    ScopeInfo* scopebuf = d->scopebuf;
+    AstNode* current_func = d->current_func;
+    AstNode** loop_stack = d->loop_stack;
+    d->scopebuf = NULL;
+    bufpush(d->scopebuf, scopebuf[0]);
+    d->current_func = NULL;
+    d->loop_stack = NULL;
+
+    bool error = sema_resolve_top_level_decl(d, decl);
+
+    scopebuf[0] = d->scopebuf[0];
+    buffree(d->scopebuf);
+    d->scopebuf = scopebuf;
+    d->current_func = current_func;
+    d->loop_stack = loop_stack;
+
+    decl->query = error ? QUERY_FAILED : QUERY_DONE;
+    return !error;
 }
 
 static AstNode** sema_check_agg_deps(SemaCtx* s, AstNode* astnode, bool* out_contains_array) {
@@ -847,6 +1144,7 @@ static AstNode** sema_check_agg_deps(SemaCtx* s, AstNode* astnode, bool* out_con
         case ASTNODE_STRUCT: {
             switch (astnode->strct.color) {
                 case CCWHITE: {
+                    if (!sema_query_decl(s, astnode, astnode->strct.identifier->span)) return NULL;
                     astnode->strct.color = CCGREY;
                     bool contains_array = astnode->strct.contains_array;
                     bufloop(astnode->strct.deps_on, i) {
@@ -856,10 +1154,16 @@ static AstNode** sema_check_agg_deps(SemaCtx* s, AstNode* astnode, bool* out_con
                             bufpush(child_ecycle, astnode);
                             return child_ecycle;
                         }
+                        if (astnode->strct.deps_on[i]->strct.color != CCBLACK) {
+                            astnode->strct.color = CCWHITE;
+                            return NULL;
+                        }
                         if (child_contarray) contains_array = true;
                     }
                     if (out_contains_array) *out_contains_array = contains_array;
                     astnode->typespec->ty->agg.pass_by_ref = contains_array;
+                    // Dependencies are laid out first.
+                    typespec_compute_struct_layout(astnode->typespec->ty);
                     astnode->strct.color = CCBLACK;
                 } break;
 
@@ -878,6 +1182,44 @@ static AstNode** sema_check_agg_deps(SemaCtx* s, AstNode* astnode, bool* out_con
     return NULL;
 }
 
+// Checks for recursive aggregates and lays out `astnode`
+// and the aggregates it contains. Returns false on error.
+static bool sema_check_agg_layout(SemaCtx* s, AstNode* astnode) {
+    AstNode** ecycle = sema_check_agg_deps(s, astnode, NULL);
+    if (ecycle) {
+        Msg msg = msg_with_span(
+            MSG_ERROR,
+            "invalid recursive aggregate",
+            ecycle[0]->span);
+        // ecycle is reversed, so first element
+        // is the erroneous aggregate
+        AstNode* eagg = ecycle[0];
+        usize actual_start = buflen(ecycle)-1;
+        bufrevloop(ecycle, k) {
+            if (ecycle[k] != eagg) continue;
+            actual_start = k;
+            break;
+        }
+        // in reverse, start variable is +1 of starting idx
+        for (usize k = actual_start+1; k-- > 0;) {
+            msg_addl_thin(
+                &msg,
+                format_string(
+                    k == 0 ? "%s" : "%s, depends on",
+                    ecycle[k]->strct.name));
+        }
+        msg_emit(s, &msg);
+        return false;
+    }
+    return astnode->strct.color == CCBLACK;
+}
+
+static bool sema_check_type_layout(SemaCtx* s, Typespec* ty) {
+    while (ty->kind == TS_ARRAY) ty = ty->array.child;
+    if (ty->kind == TS_STRUCT) return sema_check_agg_layout(s, ty->agg.ref);
+    return true;
+}
+
 static bool sema_check_bigint_overflow(SemaCtx* s, bigint* b, Span span) {
     if (b->neg && bigint_fits(b, 8, true)) {
         return false;
@@ -898,6 +1240,231 @@ static bool sema_check_bigint_overflow(SemaCtx* s, bigint* b, Span span) {
     }
 }
 
+static bool sema_check_sized_integer_overflow(SemaCtx* s, bigint* b, Typespec* ty, Span span) {
+    if (bigint_fits(b, typespec_get_bytes(ty), typespec_is_signed(ty))) {
+        return false;
+    } else {
+        Msg msg = msg_with_span(
+            MSG_ERROR,
+            b->neg ? "integer underflow" : "integer overflow",
+            span);
+        msg_addl_thin(
+            &msg,
+            format_string_with_one_type(
+                "result `%s` does not fit in type `%T`",
+                ty,
+                bigint_tostring(b)));
+        msg_emit(s, &msg);
+        return true;
+    }
+}
+
+// Folded values are at most 64-bits wide (checked by
+// `sema_check_bigint_overflow()`), so bitwise operations
+// can be done in 128-bit two's complement.
+static i128 sema_bigint_to_i128(const bigint* b) {
+    i128 val = (i128)bigint_low_u64(b);
+    return b->neg ? -val : val;
+}
+
+static bigint sema_bigint_from_i128(i128 val) {
+    u128 mag = val < 0 ? -(u128)val : (u128)val;
+    bigint b = bigint_new_u64((u64)(mag >> 64));
+    bigint_shln(&b, 64);
+    bigint lo = bigint_new_u64((u64)mag);
+    bigint_add(&b, &lo);
+    bigint_free(&lo);
+    b.neg = val < 0;
+    bigint_normalize(&b);
+    return b;
+}
+
+// Truncates `val` to the width of `ty`, the same way
+// LLVM does for casts and shifts.
+static i128 sema_wrap_integer(i128 val, Typespec* ty) {
+    u32 bits = typespec_get_bytes(ty) * 8;
+    u128 wrapped = (u128)val & (((u128)1 << bits) - 1);
+    if (typespec_is_signed(ty) && ((wrapped >> (bits-1)) & 1)) {
+        return (i128)wrapped - ((i128)1 << bits);
+    }
+    return (i128)wrapped;
+}
+
+static void sema_fold_into_integer(AstNode* astnode, bigint val) {
+    astnode->kind = ASTNODE_INTEGER_LITERAL;
+    astnode->intl.token = NULL;
+    astnode->intl.val = val;
+}
+
+static void sema_fold_into_bool(AstNode* astnode, bool val) {
+    astnode->kind = ASTNODE_BUILTIN_SYMBOL;
+    astnode->bsym.identifier = NULL;
+    astnode->bsym.kind = val ? BS_true : BS_false;
+}
+
+// Replaces an analyzed operator node with a literal if all of its
+// operands are compile-time known. Returns the node's type, or NULL
+// if evaluating it failed (overflow, division by zero, etc).
+static Typespec* sema_fold(SemaCtx* s, AstNode* astnode) {
+    Typespec* ty = astnode->typespec;
+    if (!ty) return NULL;
+
+    bigint left, right;
+    switch (astnode->kind) {
+        case ASTNODE_ARITH_BINOP: {
+            if (astnode->arthbin.ptrop) return ty;
+            // Unsized integers are already computed in their type.
+            if (typespec_is_unsized_integer(ty)) {
+                sema_fold_into_integer(astnode, ty->prim.integer);
+                return ty;
+            }
+            if (!sema_get_comptime_integer(astnode->arthbin.left, &left)
+                || !sema_get_comptime_integer(astnode->arthbin.right, &right)) return ty;
+
+            bigint new = bigint_new();
+            switch (astnode->arthbin.kind) {
+                case ARITH_BINOP_ADD: bigint_copy(&new, &left); bigint_add(&new, &right); break;
+                case ARITH_BINOP_SUB: bigint_copy(&new, &left); bigint_sub(&new, &right); break;
+                case ARITH_BINOP_MUL: bigint_copy(&new, &left); bigint_mul(&new, &right); break;
+                case ARITH_BINOP_DIV:
+                case ARITH_BINOP_REM: {
+                    if (bigint_cmp(&right, &BIGINT_ZERO) == 0) {
+                        Msg msg = msg_with_span(
+                            MSG_ERROR,
+                            "cannot divide by zero",
+                            astnode->short_span);
+                        msg_emit(s, &msg);
+                        return NULL;
+                    }
+                    bigint second = bigint_new();
+                    if (astnode->arthbin.kind == ARITH_BINOP_DIV)
+                        bigint_div_mod(&left, &right, &new, &second);
+                    else
+                        bigint_div_mod(&left, &right, &second, &new);
+                    bigint_free(&second);
+                } break;
+            }
+            if (sema_check_sized_integer_overflow(s, &new, ty, astnode->span)) return NULL;
+            sema_fold_into_integer(astnode, new);
+        } break;
+
+        case ASTNODE_BOOL_BINOP: {
+            bool lval, rval;
+            if (!sema_get_comptime_bool(astnode->boolbin.left, &lval)) return ty;
+            // The right operand is not evaluated if the left one decides
+            // the result, so it doesn't need to be known.
+            if (astnode->boolbin.kind == BOOL_BINOP_AND ? !lval : lval) {
+                sema_fold_into_bool(astnode, lval);
+            } else if (sema_get_comptime_bool(astnode->boolbin.right, &rval)) {
+                sema_fold_into_bool(astnode, rval);
+            }
+        } break;
+
+        case ASTNODE_CMP_BINOP: {
+            if (!sema_get_comptime_integer(astnode->cmpbin.left, &left)
+                || !sema_get_comptime_integer(astnode->cmpbin.right, &right)) return ty;
+            int cmp = bigint_cmp(&left, &right);
+            bool result;
+            switch (astnode->cmpbin.kind) {
+                case CMP_BINOP_EQ: result = cmp == 0; break;
+                case CMP_BINOP_NE: result = cmp != 0; break;
+                case CMP_BINOP_LT: result = cmp < 0; break;
+                case CMP_BINOP_GT: result = cmp > 0; break;
+                case CMP_BINOP_LE: result = cmp <= 0; break;
+                case CMP_BINOP_GE: result = cmp >= 0; break;
+                default: assert(0);
+            }
+            sema_fold_into_bool(astnode, result);
+        } break;
+
+        case ASTNODE_BITLG_BINOP: {
+            if (!sema_get_comptime_integer(astnode->bitlbin.left, &left)
+                || !sema_get_comptime_integer(astnode->bitlbin.right, &right)) return ty;
+            i128 lval = sema_bigint_to_i128(&left);
+            i128 rval = sema_bigint_to_i128(&right);
+            i128 result;
+            switch (astnode->bitlbin.kind) {
+                case BITLG_BINOP_AND: result = lval & rval; break;
+                case BITLG_BINOP_OR:  result = lval | rval; break;
+                case BITLG_BINOP_XOR: result = lval ^ rval; break;
+                default: assert(0);
+            }
+            bigint new = sema_bigint_from_i128(result);
+            if (typespec_is_unsized_integer(ty)) {
+                if (sema_check_bigint_overflow(s, &new, astnode->span)) return NULL;
+                ty = typespec_unsized_integer_new(new);
+                astnode->typespec = ty;
+            }
+            sema_fold_into_integer(astnode, new);
+        } break;
+
+        case ASTNODE_BITSH_BINOP: {
+            if (!sema_get_comptime_integer(astnode->bitsbin.left, &left)
+                || !sema_get_comptime_integer(astnode->bitsbin.right, &right)) return ty;
+            usize bits = typespec_get_bytes(ty) * 8;
+            i128 n = sema_bigint_to_i128(&right);
+            if (n >= 0 && n < (i128)bits) {
+                i128 lval = sema_bigint_to_i128(&left);
+                i128 result = astnode->bitsbin.kind == BITSH_BINOP_LEFT
+                    ? sema_wrap_integer((i128)((u128)lval << n), ty)
+                    : lval >> n;
+                sema_fold_into_integer(astnode, sema_bigint_from_i128(result));
+            } else {
+                Msg msg = msg_with_span(
+                    MSG_ERROR,
+                    "shift value greater/equal to number of bits",
+                    astnode->short_span);
+                msg_addl_thin(
+                    &msg,
+                    format_string(
+                        "left operand occupies %lu bits but shifting by %s",
+                        bits,
+                        bigint_tostring(&right)));
+                msg_emit(s, &msg);
+                return NULL;
+            }
+        } break;
+
+        case ASTNODE_UNOP: {
+            if (astnode->unop.kind == UNOP_ADDR) return ty;
+            if (typespec_is_unsized_integer(ty)) {
+                sema_fold_into_integer(astnode, ty->prim.integer);
+                return ty;
+            }
+            if (!sema_get_comptime_integer(astnode->unop.child, &left)) return ty;
+            switch (astnode->unop.kind) {
+                case UNOP_NEG: {
+                    bigint new = bigint_new();
+                    bigint_copy(&new, &left);
+                    bigint_neg(&new);
+                    if (sema_check_sized_integer_overflow(s, &new, ty, astnode->span)) return NULL;
+                    sema_fold_into_integer(astnode, new);
+                } break;
+
+                case UNOP_BITNOT: {
+                    i128 result = sema_wrap_integer(~sema_bigint_to_i128(&left), ty);
+                    sema_fold_into_integer(astnode, sema_bigint_from_i128(result));
+                } break;
+
+                case UNOP_BOOLNOT: {
+                    sema_fold_into_bool(astnode, bigint_cmp(&left, &BIGINT_ZERO) == 0);
+                } break;
+            }
+        } break;
+
+        case ASTNODE_CAST: {
+            Typespec* from = astnode->cast.left->typespec;
+            if (typespec_is_sized_integer(ty)
+                && (typespec_is_integer(from) || typespec_is_bool(from))
+                && sema_get_comptime_integer(astnode->cast.left, &left)) {
+                i128 result = sema_wrap_integer(sema_bigint_to_i128(&left), ty);
+                sema_fold_into_integer(astnode, sema_bigint_from_i128(result));
+            }
+        } break;
+    }
+    return ty;
+}
+
 static bool sema_access_field_from_type(SemaCtx* s, Typespec* ty, Token* key, AstNode* astnode, bool derefed) {
     AstNode* result = NULL;
 
@@ -910,6 +1477,7 @@ static bool sema_access_field_from_type(SemaCtx* s, Typespec* ty, Token* key, As
         }
 
     if (ty->kind == TS_STRUCT) {
+        if (!sema_query_decl(s, ty->agg.ref, astnode->short_span)) return false;
         AstNode** fields = ty->agg.ref->strct.fields;
         bufloop(fields, i) {
             if (are_token_lexemes_equal(
@@ -936,6 +1504,10 @@ static bool sema_access_field_from_type(SemaCtx* s, Typespec* ty, Token* key, As
                 "symbol not found in module",
                 astnode->short_span);
             msg_emit(s, &msg);
+        } else if (result->kind != ASTNODE_STRUCT
+                   && sema_is_query_decl(result)
+                   && !sema_query_decl(s, result, astnode->short_span)) {
+            return false;
         }
     } else if (ty->kind == TS_PRIM) {
         sema_symbol_not_found_in_type_error(ty);
@@ -1084,6 +1656,64 @@ static bool sema_ifbranch(
     return error;
 }
 
+// Drops branches whose condition is compile-time known to be `false`,
+// and turns the first branch known to be `true` into the `else` branch.
+// If no conditional branch is left, `astnode` is replaced by the body
+// of the remaining branch (or an empty block).
+static void sema_prune_if(AstNode* astnode) {
+    AstNode** brs = NULL;
+    bufpush(brs, astnode->iff.ifbr);
+    bufloop(astnode->iff.elseifbr, i) bufpush(brs, astnode->iff.elseifbr[i]);
+    if (astnode->iff.elsebr) bufpush(brs, astnode->iff.elsebr);
+
+    AstNode** live = NULL;
+    AstNode* elsebr = NULL;
+    bool pruned = false;
+    bufloop(brs, i) {
+        bool cond;
+        if (brs[i]->ifbr.kind == IFBR_ELSE) {
+            elsebr = brs[i];
+            break;
+        } else if (sema_get_comptime_bool(brs[i]->ifbr.cond, &cond)) {
+            pruned = true;
+            if (cond) {
+                elsebr = brs[i];
+                break;
+            }
+        } else bufpush(live, brs[i]);
+    }
+    buffree(brs);
+    if (!pruned) {
+        buffree(live);
+        return;
+    }
+
+    if (buflen(live) == 0) {
+        if (elsebr) {
+            // The body keeps its own type, so that users of the
+            // `if` still convert it to theirs (e.g. array to slice).
+            *astnode = *elsebr->ifbr.body;
+        } else {
+            astnode->kind = ASTNODE_SCOPED_BLOCK;
+            astnode->blk.stmts = NULL;
+            astnode->blk.yield_keyword = NULL;
+            astnode->blk.val = NULL;
+            astnode->blk.rbrace = NULL;
+        }
+        return;
+    }
+
+    live[0]->ifbr.kind = IFBR_IF;
+    astnode->iff.ifbr = live[0];
+    astnode->iff.elseifbr = NULL;
+    for (usize i = 1; i < buflen(live); i++) {
+        bufpush(astnode->iff.elseifbr, live[i]);
+    }
+    if (elsebr) elsebr->ifbr.kind = IFBR_ELSE;
+    astnode->iff.elsebr = elsebr;
+    buffree(live);
+}
+
 static Typespec* sema_scoped_block(SemaCtx* s, AstNode* astnode, Typespec* target, bool open_new_scope) {
     if (open_new_scope) sema_scope_push(s);
     bool error = false;
@@ -1307,6 +1937,8 @@ static bool sema_check_ctrlflow_for_comptimeonly_val(SemaCtx* s, bool error, Ast
 static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
     switch (astnode->kind) {
         case ASTNODE_INTEGER_LITERAL: {
+            // Already analyzed and folded
+            if (!astnode->intl.token) return astnode->typespec;
             // TODO: check for `target`
             if (sema_check_bigint_overflow(s, &astnode->intl.val, astnode->span)) {
                 return NULL;
@@ -1380,6 +2012,158 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
             }
         } break;
 
+        case ASTNODE_DIRECTIVE: {
+            Token* callee = astnode->directive.callee;
+            AstNode** args = astnode->directive.args;
+            bool sizeof_dir = is_token_lexeme(callee, "sizeOf");
+            bool alignof_dir = is_token_lexeme(callee, "alignOf");
+            bool offsetof_dir = is_token_lexeme(callee, "offsetOf");
+            if (!sizeof_dir && !alignof_dir && !offsetof_dir) {
+                Msg msg = msg_with_span(
+                    MSG_ERROR,
+                    "unknown directive",
+                    callee->span);
+                msg_emit(s, &msg);
+                return NULL;
+            }
+
+            usize expected_args = offsetof_dir ? 2 : 1;
+            if (buflen(args) != expected_args) {
+                Msg msg = msg_with_span(
+                    MSG_ERROR,
+                    format_string("expected %lu argument(s), found %lu", expected_args, buflen(args)),
+                    astnode->span);
+                msg_emit(s, &msg);
+                return NULL;
+            }
+
+            Typespec* ty = sema_astnode(s, args[0], NULL);
+            if (!(ty && sema_verify_istype(s, ty, AT_STORAGE_TYPE, args[0]->span))) return NULL;
+            if (!sema_check_type_layout(s, ty->ty)) return NULL;
+
+            u64 val;
+            if (sizeof_dir) {
+                val = typespec_get_size(ty->ty);
+            } else if (alignof_dir) {
+                val = typespec_get_align(ty->ty);
+            } else {
+                if (ty->ty->kind != TS_STRUCT) {
+                    Msg msg = msg_with_span(
+                        MSG_ERROR,
+                        format_string_with_one_type("expected aggregate type, got `%T`", ty->ty),
+                        args[0]->span);
+                    msg_emit(s, &msg);
+                    return NULL;
+                }
+                if (args[1]->kind != ASTNODE_SYMBOL) {
+                    Msg msg = msg_with_span(
+                        MSG_ERROR,
+                        "expected field name",
+                        args[1]->span);
+                    msg_emit(s, &msg);
+                    return NULL;
+                }
+
+                AstNode* field = NULL;
+                AstNode** fields = ty->ty->agg.ref->strct.fields;
+                bufloop(fields, i) {
+                    if (are_token_lexemes_equal(fields[i]->field.key, args[1]->sym.identifier)) {
+                        field = fields[i];
+                        break;
+                    }
+                }
+                if (!field) {
+                    Msg msg = msg_with_span(
+                        MSG_ERROR,
+                        format_string_with_one_type("symbol not found in type `%T`", ty->ty),
+                        args[1]->span);
+                    msg_emit(s, &msg);
+                    return NULL;
+                }
+                val = field->field.offset;
+            }
+
+            astnode->typespec = typespec_unsized_integer_new(bigint_new_u64(val));
+            sema_fold_into_integer(astnode, astnode->typespec->prim.integer);
+            return astnode->typespec;
+        } break;
+
+        case ASTNODE_AGGREGATE_LITERAL: {
+            Typespec* ty = sema_astnode(s, astnode->aggl.typespec, NULL);
+            if (!(ty && sema_verify_istype(s, ty, AT_STORAGE_TYPE, astnode->aggl.typespec->span))) return NULL;
+            if (ty->ty->kind != TS_STRUCT) {
+                Msg msg = msg_with_span(
+                    MSG_ERROR,
+                    format_string_with_one_type("expected aggregate type, got `%T`", ty->ty),
+                    astnode->aggl.typespec->span);
+                msg_emit(s, &msg);
+                return NULL;
+            }
+
+            if (!sema_query_decl(s, ty->ty->agg.ref, astnode->aggl.typespec->span)) return NULL;
+            AstNode** fields = ty->ty->agg.ref->strct.fields;
+
+            bool error = false;
+            AstNode** initialized = NULL;
+            bufloop(fields, i) bufpush(initialized, NULL);
+
+            bufloop(astnode->aggl.fields, i) {
+                AstNode* litfield = astnode->aggl.fields[i];
+                AstNode* field = NULL;
+                bufloop(fields, j) {
+                    if (are_token_lexemes_equal(fields[j]->field.key, litfield->field.key)) {
+                        field = fields[j];
+                        break;
+                    }
+                }
+
+                if (!field) {
+                    Msg msg = msg_with_span(
+                        MSG_ERROR,
+                        format_string_with_one_type("symbol not found in type `%T`", ty->ty),
+                        litfield->field.key->span);
+                    msg_emit(s, &msg);
+                    error = true;
+                    continue;
+                } else if (initialized[field->field.idx]) {
+                    Msg msg = msg_with_span(
+                        MSG_ERROR,
+                        "field initialized more than once",
+                        litfield->span);
+                    msg_addl_fat(&msg, "previously initialized here:", initialized[field->field.idx]->span);
+                    msg_emit(s, &msg);
+                    error = true;
+                    continue;
+                }
+                initialized[field->field.idx] = litfield;
+                litfield->field.idx = field->field.idx;
+
+                Typespec* value = sema_astnode(s, litfield->field.value, field->typespec);
+                if (value && sema_verify_isvalue(s, value, AT_DEFAULT_VALUE, litfield->field.value->span)) {
+                    if (sema_check_types_equal(s, value, field->typespec, false, litfield->field.value->span)) {
+                        litfield->typespec = field->typespec;
+                    } else error = true;
+                } else error = true;
+            }
+
+            if (!error) {
+                bufloop(fields, i) {
+                    if (initialized[i]) continue;
+                    Msg msg = msg_with_span(
+                        MSG_ERROR,
+                        format_string("missing field `%s` in literal", token_tostring(fields[i]->field.key)),
+                        astnode->span);
+                    msg_emit(s, &msg);
+                    error = true;
+                }
+            }
+            buffree(initialized);
+
+            if (error) return NULL;
+            astnode->typespec = ty->ty;
+            return astnode->typespec;
+        } break;
+
         case ASTNODE_UNOP: {
             Typespec* child = sema_astnode(s, astnode->unop.child, NULL);
             switch (astnode->unop.kind) {
@@ -1388,7 +2172,7 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                         if (typespec_is_sized_integer(child)) {
                             if (typespec_is_signed(child)) {
                                 astnode->typespec = child;
-                                return child;
+                                return sema_fold(s, astnode);
                             } else {
                                 Msg msg = msg_with_span(
                                     MSG_ERROR,
@@ -1403,9 +2187,8 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                             bigint_neg(&new);
                             if (sema_check_bigint_overflow(s, &new, astnode->span)) return NULL;
 
-                            Typespec* tynew = typespec_unsized_integer_new(new);
-                            astnode->typespec = tynew;
-                            return tynew;
+                            astnode->typespec = typespec_unsized_integer_new(new);
+                            return sema_fold(s, astnode);
                         } else {
                             Msg msg = msg_with_span(
                                 MSG_ERROR,
@@ -1421,7 +2204,7 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                     if (child && sema_verify_isvalue(s, child, AT_DEFAULT_VALUE, astnode->unop.child->span)) {
                         if (sema_check_types_equal(s, child, predef_typespecs.bool_type->ty, false, astnode->unop.child->span)) {
                             astnode->typespec = predef_typespecs.bool_type->ty;
-                            return astnode->typespec;
+                            return sema_fold(s, astnode);
                         } else return NULL;
                     } else return NULL;
                 } break;
@@ -1430,7 +2213,7 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                     if (child && sema_verify_isvalue(s, child, AT_DEFAULT_VALUE, astnode->unop.child->span)) {
                         if (typespec_is_sized_integer(child)) {
                             astnode->typespec = child;
-                            return astnode->typespec;
+                            return sema_fold(s, astnode);
                         } else {
                             Msg msg = msg_with_span(
                                 MSG_ERROR,
@@ -1445,6 +2228,7 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                 case UNOP_ADDR: {
                     if (child && sema_verify_isvalue(s, child, AT_RUNTIME|AT_FUNC/*TODO: check error handling*/, astnode->unop.child->span)) {
                         if (sema_check_is_lvalue(s, astnode->unop.child)) {
+                            sema_mark_addr_taken(astnode->unop.child);
                             bool imm = sema_is_lvalue_imm(astnode->unop.child);
                             astnode->typespec = typespec_ptr_new(imm, child);
                             return astnode->typespec;
@@ -1518,6 +2302,25 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                 }
             } else error = true;
 
+            if (!error) {
+                Typespec* arr = astnode->idx.left->typespec;
+                if (arr->kind == TS_PTR) arr = arr->ptr.child;
+                bigint idxval;
+                if (arr->kind == TS_ARRAY
+                    && sema_get_comptime_integer(astnode->idx.idx, &idxval)
+                    && bigint_cmp(&idxval, &arr->array.size->prim.integer) >= 0) {
+                    Msg msg = msg_with_span(
+                        MSG_ERROR,
+                        format_string_with_one_type(
+                            "index `%s` is out of bounds for type `%T`",
+                            arr,
+                            bigint_tostring(&idxval)),
+                        astnode->idx.idx->span);
+                    msg_emit(s, &msg);
+                    error = true;
+                }
+            }
+
             return error ? NULL : astnode->typespec;
         } break;
 
@@ -1550,7 +2353,7 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                                     left,
                                     right,
                                     astnode->short_span);
-                            return astnode->typespec;
+                            return sema_fold(s, astnode);
                         } else if (left_is_unsized_integer && right_is_unsized_integer) {
                             bigint new = bigint_new();
                             if (astnode->arthbin.kind == ARITH_BINOP_ADD
@@ -1600,16 +2403,15 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
 
                             if (sema_check_bigint_overflow(s, &new, astnode->span)) return NULL;
 
-                            Typespec* tynew = typespec_unsized_integer_new(new);
-                            astnode->typespec = tynew;
-                            return tynew;
+                            astnode->typespec = typespec_unsized_integer_new(new);
+                            return sema_fold(s, astnode);
                         } else {
                             astnode->typespec = sema_check_one_unsized_one_sized_integer_operand(
                                     s,
                                     left,
                                     right,
                                     astnode->short_span);
-                            return astnode->typespec;
+                            return sema_fold(s, astnode);
                         }
                     } else if ((astnode->arthbin.kind == ARITH_BINOP_ADD || astnode->arthbin.kind == ARITH_BINOP_SUB) &&
                                left->kind == TS_MULTIPTR && right_is_anyint) {
@@ -1635,7 +2437,7 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                     bool right_bool = sema_check_types_equal(s, right, predef_typespecs.bool_type->ty, false, astnode->boolbin.right->span);
                     if (left_bool && right_bool) {
                         astnode->typespec = predef_typespecs.bool_type->ty;
-                        return astnode->typespec;
+                        return sema_fold(s, astnode);
                     } else return NULL;
                 } else return NULL;
             } else return NULL;
@@ -1709,7 +2511,7 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                         sema_cmp_binop_operator_not_defined_for_error();
                     }
                     astnode->typespec = predef_typespecs.bool_type->ty;
-                    return astnode->typespec;
+                    return sema_fold(s, astnode);
 
                 } else return NULL;
             } else return NULL;
@@ -1739,7 +2541,7 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                                     astnode->short_span);
                         }
                     } else sema_binop_invalid_operands(left, right);
-                    return astnode->typespec;
+                    return sema_fold(s, astnode);
                 } else return NULL;
             } else return NULL;
         } break;
@@ -1781,7 +2583,7 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                                     astnode->short_span);
                                 msg_emit(s, &msg);
                                 return NULL;
-                            } else if (right->prim.integer.d[0] >= left_bits) {
+                            } else if (bigint_low_u64(&right->prim.integer) >= left_bits) {
                                 Msg msg = msg_with_span(
                                     MSG_ERROR,
                                     "shift value greater/equal to number of bits",
@@ -1791,14 +2593,14 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                                     format_string(
                                         "left operand occupies %lu bits but shifting by %lu",
                                         left_bits,
-                                        right->prim.integer.d[0]));
+                                        bigint_low_u64(&right->prim.integer)));
                                 msg_emit(s, &msg);
                                 return NULL;
                             }
                         }
 
                         astnode->typespec = left;
-                        return astnode->typespec;
+                        return sema_fold(s, astnode);
                     } else sema_binop_invalid_operands(left, right);
                 } else return NULL;
             } else return NULL;
@@ -1895,7 +2697,7 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
                     return NULL;
                 } else {
                     astnode->typespec = inright;
-                    return astnode->typespec;
+                    return sema_fold(s, astnode);
                 }
             } else return NULL;
         } break;
@@ -1951,6 +2753,11 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
             if (child && sema_verify_istype(s, child, AT_STORAGE_TYPE, astnode->typearray.child->span)) {
             } else error = true;
             if (size && sema_verify_isvalue(s, size, AT_DEFAULT_VALUE, astnode->typearray.size->span)) {
+                bigint folded_size;
+                if (typespec_is_sized_integer(size) && sema_get_comptime_integer(astnode->typearray.size, &folded_size)) {
+                    size = typespec_unsized_integer_new(folded_size);
+                }
+
                 if (typespec_is_unsized_integer(size)) {
                     if (size->prim.integer.neg) {
                         Msg msg = msg_with_span(
@@ -2111,6 +2918,10 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
         case ASTNODE_SYMBOL: {
             AstNode* node = sema_scope_retrieve(s, astnode->sym.identifier);
             if (node) {
+                // Structs are usable as types before their fields are resolved.
+                if (node->kind != ASTNODE_STRUCT
+                    && sema_is_query_decl(node)
+                    && !sema_query_decl(s, node, astnode->span)) return NULL;
                 astnode->typespec = node->typespec;
                 astnode->sym.ref = node;
             }
@@ -2193,6 +3004,7 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
             }
 
             if (sema_check_ctrlflow_for_comptimeonly_val(s, error, astnode)) error = true;
+            if (!error) sema_prune_if(astnode);
 
             return error ? NULL : astnode->typespec;
         } break;
@@ -2305,6 +3117,7 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
             }
 
             astnode->ret.ref = s->current_func;
+            bufpush(s->current_func->funcdef.returns, astnode);
             Typespec* func_ret = astnode->ret.ref->typespec->func.ret_typespec;
 
             if (func_ret->kind == TS_noreturn) {
@@ -2365,10 +3178,11 @@ static Typespec* sema_astnode(SemaCtx* s, AstNode* astnode, Typespec* target) {
     return NULL;
 }
 
-bool sema(SemaCtx* sema_ctxs) {
+bool sema_decls(SemaCtx* sema_ctxs) {
     bool error = false;
     bufloop(sema_ctxs, i) {
         SemaCtx* s = &sema_ctxs[i];
+        s->sema_ctxs = sema_ctxs;
         bufloop(s->srcfile->astnodes, j) {
             sema_top_level_decls_prec1(s, s->srcfile->astnodes[j]);
         }
@@ -2379,59 +3193,53 @@ bool sema(SemaCtx* sema_ctxs) {
     bufloop(sema_ctxs, i) {
         SemaCtx* s = &sema_ctxs[i];
         bufloop(s->srcfile->astnodes, j) {
-            sema_top_level_decls_prec2(s, s->srcfile->astnodes[j]);
+            AstNode* astnode = s->srcfile->astnodes[j];
+            if (sema_is_query_decl(astnode)) sema_query_decl(s, astnode, astnode->short_span);
         }
-        if (s->error) error = true;
+    }
+    // Queries may report errors in any module.
+    bufloop(sema_ctxs, i) {
+        if (sema_ctxs[i].error) error = true;
     }
     if (error) return true;
 
     bufloop(sema_ctxs, i) {
         SemaCtx* s = &sema_ctxs[i];
         bufloop(s->srcfile->astnodes, j) {
-            if (s->srcfile->astnodes[j]->kind == ASTNODE_STRUCT) {
-                AstNode** ecycle = sema_check_agg_deps(s, s->srcfile->astnodes[j], NULL);
-                if (ecycle) {
-                    Msg msg = msg_with_span(
-                        MSG_ERROR,
-                        "invalid recursive aggregate",
-                        ecycle[0]->span);
-                    // ecycle is reversed, so first element
-                    // is the erroneous aggregate
-                    AstNode* eagg = ecycle[0];
-                    usize actual_start = buflen(ecycle)-1;
-                    bufrevloop(ecycle, k) {
-                        if (ecycle[k] != eagg) continue;
-                        actual_start = k;
-                        break;
-                    }
-                    // in reverse, start variable is +1 of starting idx
-                    for (usize k = actual_start+1; k-- > 0;) {
-                        msg_addl_thin(
-                            &msg,
-                            format_string(
-                                k == 0 ? "%s" : "%s, depends on",
-                                ecycle[k]->strct.name));
-                    }
-                    msg_emit(s, &msg);
-                    break;
-                }
-            }
+            AstNode* astnode = s->srcfile->astnodes[j];
+            if (astnode->kind == ASTNODE_STRUCT && !sema_check_agg_layout(s, astnode)) break;
         }
         if (s->error) {
             error = true;
             break;
         }
     }
-    if (error) return true;
+    return error;
+}
 
+bool sema_bodies(SemaCtx* sema_ctxs) {
+    bool error = false;
     bufloop(sema_ctxs, i) {
         SemaCtx* s = &sema_ctxs[i];
+        CompileCtx* c = s->compile_ctx;
+        // The lints look at the checked bodies.
+        bool reuse = s->srcfile->cached_bitcode && !c->warn_perf;
+        usize nmsgs = buflen(c->msgs);
         bufloop(s->srcfile->astnodes, j) {
-            sema_astnode(s, s->srcfile->astnodes[j], NULL);
+            AstNode* astnode = s->srcfile->astnodes[j];
+            if (astnode->kind == ASTNODE_FUNCTION_DEF) {
+                if (reuse) {
+                    c->body_query_hits++;
+                    continue;
+                }
+                c->body_queries++;
+            }
+            sema_astnode(s, astnode, NULL);
         }
         if (s->error) error = true;
-    }
-    if (error) return true;
 
-    return false;
+        // Warnings wouldn't be repeated when the module is reused.
+        if (buflen(c->msgs) != nmsgs) s->srcfile->cache_key = NULL;
+    }
+    return error;
 }
@@ -18,7 +18,7 @@ typedef struct {
     TokenAstNodeTup* decls;
 } ScopeInfo;
 
-typedef struct {
+typedef struct SemaCtx {
     struct Srcfile* srcfile;
     struct CompileCtx* compile_ctx;
     ScopeInfo* scopebuf;
@@ -26,11 +26,21 @@ typedef struct {
 
     AstNode* current_func;
     AstNode** loop_stack;
+
+    // Contexts of all modules, used to resolve
+    // declarations of other modules on demand.
+    struct SemaCtx* sema_ctxs;
 } SemaCtx;
 
 SemaCtx sema_new_context(
     struct Srcfile* srcfile,
     struct CompileCtx* compile_ctx);
-bool sema(SemaCtx* sema_ctxs);
+// Resolves all top-level declarations and lays out aggregates.
+// Returns true on error.
+bool sema_decls(SemaCtx* sema_ctxs);
+// Checks function bodies, except in modules whose code is reused
+// from the cache, which were checked by the build that cached them.
+// Returns true on error.
+bool sema_bodies(SemaCtx* sema_ctxs);
 
 #endif
@@ -4,6 +4,12 @@
 #include "../msg.h"
 #include "../compile.h"
 
+#include <dirent.h>
+
+#ifdef TEST_BENCH
+#include <time.h>
+#endif
+
 typedef struct {
     MsgKind kind;
     const char* msg;
@@ -19,7 +25,9 @@ static void initialize_test(
     Srcfile* srcfiles,
     usize test_call_line,
     const char* testname,
-    const char* srccode)
+    const char* srccode,
+    const char* ir_path,
+    bool warn_perf)
 {
     total_tests++;
 #ifdef TEST_PRINT_COMPILER_MSGS
@@ -53,6 +61,8 @@ static void initialize_test(
 
     read_srcfile("core", "core", span_none(), &test_ctx);
 
+    test_ctx.emit_paths[EMIT_LLVM_IR] = ir_path;
+    test_ctx.warn_perf = warn_perf;
     compile(&test_ctx);
     *out_test_ctx = test_ctx;
 }
@@ -97,7 +107,7 @@ static void _test_valid(
 {
     CompileCtx test_ctx;
     Srcfile srcfiles[1];
-    initialize_test(&test_ctx, &srcfiles[0], test_call_line, testname, srccode);
+    initialize_test(&test_ctx, &srcfiles[0], test_call_line, testname, srccode, NULL, false);
 
     bool error = false;
     if (buflen(test_ctx.msgs) > 0) {
@@ -125,11 +135,12 @@ static void _test_invalid(
     const char* testname,
     const char* srccode,
     usize num_msgs,
-    TestMsgSpec* msgs)
+    TestMsgSpec* msgs,
+    bool warn_perf)
 {
     CompileCtx test_ctx;
     Srcfile srcfiles[1];
-    initialize_test(&test_ctx, &srcfiles[0], test_call_line, testname, srccode);
+    initialize_test(&test_ctx, &srcfiles[0], test_call_line, testname, srccode, NULL, warn_perf);
 
     bool error = false;
     if (buflen(test_ctx.msgs) == num_msgs) {
@@ -207,7 +218,11 @@ static void _test_invalid(
 }
 
 #define test_invalid(testname, srccode, num_msgs, msgs) \
-    (_test_invalid(__FILE__, __LINE__, (testname), (srccode), (num_msgs), (msgs)))
+    (_test_invalid(__FILE__, __LINE__, (testname), (srccode), (num_msgs), (msgs), false))
+
+// Like test_invalid, with `--Wperf`.
+#define test_lint(testname, srccode, num_msgs, msgs) \
+    (_test_invalid(__FILE__, __LINE__, (testname), (srccode), (num_msgs), (msgs), true))
 
 static void _test_invalid_one_errspan(
     const char* test_call_filename,
@@ -236,17 +251,537 @@ static void _test_invalid_one_errspan(
                     .exists = true,
                 },
             },
-        })
+        }),
+        false
     );
 }
 
 #define test_invalid_one_errspan(testname, srccode, msg, line, col) \
     (_test_invalid_one_errspan(__FILE__, __LINE__, (testname), (srccode), (msg), (line), (col)))
 
+// Checks that the file at `path` contains every one of `patterns`,
+// or doesn't for ones starting with '!'.
+static void check_patterns(
+    const char* path,
+    const char* what,
+    usize num_patterns,
+    const char** patterns,
+    bool* error)
+{
+    FileOrError efile = read_file(path);
+    if (efile.status != FILEIO_SUCCESS) {
+        if (!*error) print_fail_text();
+        *error = true;
+        fprintf(stderr, "\n  >> Expected %s to be written to '%s'", what, path);
+        return;
+    }
+    for (usize i = 0; i < num_patterns; i++) {
+        bool absent = patterns[i][0] == '!';
+        const char* pattern = absent ? patterns[i]+1 : patterns[i];
+        if ((strstr(efile.handle.contents, pattern) != NULL) == absent) {
+            if (!*error) print_fail_text();
+            *error = true;
+            fprintf(
+                stderr,
+                "\n  >> Expected %s %s \"%s%s%s\"",
+                what,
+                absent ? "not to contain" : "to contain",
+                g_bold_color,
+                pattern,
+                g_reset_color);
+        }
+    }
+}
+
+// Compiles `srccode` and checks that the emitted IR contains
+// every one of `patterns`, or doesn't for ones starting with '!'.
+static void _test_ir(
+    const char* test_call_filename,
+    usize test_call_line,
+    const char* testname,
+    const char* srccode,
+    usize num_patterns,
+    const char** patterns)
+{
+    CompileCtx test_ctx;
+    Srcfile srcfiles[1];
+    char ir_path[] = "/tmp/aria-test-XXXXXX.ll";
+    int fd = mkstemps(ir_path, 3);
+    assert(fd != -1);
+    close(fd);
+    initialize_test(&test_ctx, &srcfiles[0], test_call_line, testname, srccode, ir_path, false);
+
+    bool error = false;
+    if (buflen(test_ctx.msgs) > 0) {
+        print_fail_text();
+        error = true;
+        fprintf(
+            stderr,
+            "\n  >> Expected no msgs, got %lu msgs",
+            buflen(test_ctx.msgs));
+    } else {
+        check_patterns(ir_path, "IR", num_patterns, patterns, &error);
+    }
+    unlink(ir_path);
+
+    print_test_result(
+        &test_ctx,
+        error,
+        test_call_filename,
+        test_call_line);
+}
+
+#define test_ir(testname, srccode, num_patterns, patterns) \
+    (_test_ir(__FILE__, __LINE__, (testname), (srccode), (num_patterns), (patterns)))
+
+typedef struct {
+    const char* name;
+    const char* contents;
+} TestFile;
+
+// A test that compiles real files, as if they were given on the
+// command line in order, along with `core`.
+typedef struct {
+    TestFile* files;
+    usize num_files;
+    // Builds without the runtime's start code, as with `--naked`.
+    bool naked;
+    OptLevel opt_level;
+    const char* cpu;
+    const char* features;
+    usize codegen_threads;
+    LtoMode lto_mode;
+    // Reuses module bitcode from the cache in `$XDG_CACHE_HOME`.
+    bool use_cache;
+    // Links an executable and runs it, or runs the program in-process
+    // with `aria run`, and compares the exit status with `exit_code`.
+    bool link;
+    bool run;
+    int exit_code;
+    // Also writes `out.o` and `out.bc` for `check` to look at.
+    bool emit_obj;
+    bool emit_bc;
+    // Checked against the emitted IR and assembly, as in test_ir.
+    usize num_ir_patterns;
+    const char** ir_patterns;
+    usize num_asm_patterns;
+    const char** asm_patterns;
+    // Extra checks on the finished build. Returns what went wrong,
+    // or NULL.
+    const char* (*check)(CompileCtx* c, const char* dir);
+} TestBuild;
+
+static char* test_make_dir() {
+    char* dir = format_string("/tmp/aria-test-XXXXXX");
+    char* made = mkdtemp(dir);
+    assert(made);
+    return dir;
+}
+
+static void test_write_file(const char* dir, const char* name, const char* contents) {
+    FILE* file = fopen(format_string("%s/%s", dir, name), "w");
+    assert(file);
+    fputs(contents, file);
+    fclose(file);
+}
+
+static void test_remove_dir(const char* dir) {
+    DIR* d = opendir(dir);
+    if (!d) return;
+    struct dirent* entry;
+    while ((entry = readdir(d))) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char* path = format_string("%s/%s", dir, entry->d_name);
+        struct stat st;
+        if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode)) test_remove_dir(path);
+        else unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+static bool test_is_ir_file(const char* name) {
+    usize len = strlen(name);
+    return len >= 3 && (strcmp(name+len-3, ".ll") == 0 || strcmp(name+len-3, ".bc") == 0);
+}
+
+// Reads the files in `dir` into `c` the way the driver does, and
+// compiles them.
+static void test_compile_files(CompileCtx* c, const char* dir, TestFile* files, usize num_files) {
+#ifdef TEST_PRINT_COMPILER_MSGS
+    c->print_msg_to_stderr = true;
+#else
+    c->print_msg_to_stderr = false;
+#endif
+    for (usize i = 0; i < num_files; i++) {
+        char* path = format_string("%s/%s", dir, files[i].name);
+        if (test_is_ir_file(files[i].name)) bufpush(c->ir_files, path);
+        else read_srcfile(path, NULL, span_none(), c);
+    }
+    read_srcfile("core", "core", span_none(), c);
+    compile(c);
+}
+
+// Returns the exit status of the program at `path`, or -1 if it
+// didn't exit normally.
+static int test_run_executable(const char* path) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(path, path, (char*)NULL);
+        _exit(127);
+    }
+    int status;
+    if (pid == -1 || waitpid(pid, &status, 0) == -1) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void _test_build(
+    const char* test_call_filename,
+    usize test_call_line,
+    const char* testname,
+    TestBuild build)
+{
+    total_tests++;
+    fprintf(stderr, "Testing \"%s\" (%lu)... ", testname, test_call_line);
+
+    char* dir = test_make_dir();
+    for (usize i = 0; i < build.num_files; i++) {
+        test_write_file(dir, build.files[i].name, build.files[i].contents);
+    }
+
+    CompileCtx test_ctx = compile_new_context(NULL, NULL, build.naked);
+    test_ctx.opt_level = build.opt_level;
+    test_ctx.cpu = build.cpu;
+    test_ctx.features = build.features;
+    test_ctx.codegen_threads = build.codegen_threads ? build.codegen_threads : 1;
+    test_ctx.lto_mode = build.lto_mode;
+    test_ctx.use_cache = build.use_cache;
+    test_ctx.run = build.run;
+    char* ir_path = format_string("%s/out.ll", dir);
+    char* asm_path = format_string("%s/out.s", dir);
+    char* exe_path = format_string("%s/a.out", dir);
+    if (build.emit_obj) test_ctx.emit_paths[EMIT_OBJ] = format_string("%s/out.o", dir);
+    if (build.emit_bc) test_ctx.emit_paths[EMIT_LLVM_BC] = format_string("%s/out.bc", dir);
+    if (build.num_ir_patterns) test_ctx.emit_paths[EMIT_LLVM_IR] = ir_path;
+    if (build.num_asm_patterns) test_ctx.emit_paths[EMIT_ASM] = asm_path;
+    if (build.link) test_ctx.emit_paths[EMIT_LINK] = exe_path;
+    test_compile_files(&test_ctx, dir, build.files, build.num_files);
+
+    bool error = false;
+    if (buflen(test_ctx.msgs) > 0) {
+        print_fail_text();
+        error = true;
+        fprintf(
+            stderr,
+            "\n  >> Expected no msgs, got %lu msgs",
+            buflen(test_ctx.msgs));
+    } else {
+        if (build.num_ir_patterns) {
+            check_patterns(ir_path, "IR", build.num_ir_patterns, build.ir_patterns, &error);
+        }
+        if (build.num_asm_patterns) {
+            check_patterns(asm_path, "assembly", build.num_asm_patterns, build.asm_patterns, &error);
+        }
+        if (build.link || build.run) {
+            int exit_code = build.run ? test_ctx.run_exit_code : test_run_executable(exe_path);
+            if (exit_code != build.exit_code) {
+                if (!error) print_fail_text();
+                error = true;
+                fprintf(stderr, "\n  >> Expected exit status %d, got %d", build.exit_code, exit_code);
+            }
+        }
+        const char* failure = build.check ? build.check(&test_ctx, dir) : NULL;
+        if (failure) {
+            if (!error) print_fail_text();
+            error = true;
+            fprintf(stderr, "\n  >> %s", failure);
+        }
+    }
+    test_remove_dir(dir);
+
+    print_test_result(
+        &test_ctx,
+        error,
+        test_call_filename,
+        test_call_line);
+}
+
+#define test_build(testname, ...) \
+    (_test_build(__FILE__, __LINE__, (testname), (TestBuild){ __VA_ARGS__ }))
+
+static bool test_file_starts_with(const char* path, const char* magic, usize len) {
+    FileOrError efile = read_file(path);
+    return efile.status == FILEIO_SUCCESS
+        && efile.handle.len >= len
+        && memcmp(efile.handle.contents, magic, len) == 0;
+}
+
+static usize test_count_dir_entries(const char* dir) {
+    DIR* d = opendir(dir);
+    if (!d) return 0;
+    usize n = 0;
+    struct dirent* entry;
+    while ((entry = readdir(d))) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) n++;
+    }
+    closedir(d);
+    return n;
+}
+
+static const char* test_check_all_outputs(CompileCtx* c, const char* dir) {
+    if (!test_file_starts_with(format_string("%s/out.o", dir), "\x7f" "ELF", 4)) return "out.o isn't an ELF object";
+    if (!test_file_starts_with(format_string("%s/out.bc", dir), "BC\xc0\xde", 4)) return "out.bc isn't bitcode";
+    // main.ar and the five outputs.
+    usize entries = test_count_dir_entries(dir);
+    if (entries != 6) return format_string("Expected 6 files in the build directory, got %lu", entries);
+    return NULL;
+}
+
+// `$TMPDIR` while a test runs.
+static char* test_tmpdir = NULL;
+
+static const char* test_tmpdir_is_empty(CompileCtx* c, const char* dir) {
+    usize entries = test_count_dir_entries(test_tmpdir);
+    if (entries != 0) return format_string("Expected $TMPDIR to be empty, got %lu files", entries);
+    return NULL;
+}
+
+static const char* test_tmpdir_kept_sentinel(CompileCtx* c, const char* dir) {
+    FileOrError efile = read_file(format_string("%s/mod.o", test_tmpdir));
+    if (efile.status != FILEIO_SUCCESS || strcmp(efile.handle.contents, "sentinel") != 0) {
+        return "$TMPDIR/mod.o was overwritten";
+    }
+    usize entries = test_count_dir_entries(test_tmpdir);
+    if (entries != 1) return format_string("Expected only mod.o in $TMPDIR, got %lu files", entries);
+    return NULL;
+}
+
+static const char* test_split_into_parts(CompileCtx* c, const char* dir) {
+    if (buflen(c->part_obj_paths) < 2) {
+        return format_string("Expected the module to be split, got %lu parts", buflen(c->part_obj_paths));
+    }
+    return NULL;
+}
+
+static char* test_saved_cache_key = NULL;
+
+static const char* test_main_cache_key(CompileCtx* c) {
+    bufloop(c->mod_tys, i) {
+        Srcfile* srcfile = c->mod_tys[i]->mod.srcfile;
+        const char* path = srcfile->handle.path;
+        usize len = strlen(path);
+        if (len >= 8 && strcmp(path+len-8, "/main.ar") == 0) return srcfile->cache_key;
+    }
+    return NULL;
+}
+
+static const char* test_save_cache_key(CompileCtx* c, const char* dir) {
+    const char* key = test_main_cache_key(c);
+    if (!key) return "main.ar has no cache key";
+    test_saved_cache_key = format_string("%s", key);
+    return NULL;
+}
+
+static const char* test_cache_all_hits(CompileCtx* c, const char* dir) {
+    if (c->cache_misses != 0 || c->cache_hits == 0) {
+        return format_string("Expected only cache hits, got %lu hits and %lu misses", c->cache_hits, c->cache_misses);
+    }
+    if (c->body_queries != 0) {
+        return format_string("Expected no function bodies to be checked, got %lu", c->body_queries);
+    }
+    const char* key = test_main_cache_key(c);
+    if (!key || strcmp(key, test_saved_cache_key) != 0) return "main.ar's cache key changed";
+    return NULL;
+}
+
+static const char* test_cache_key_changed(CompileCtx* c, const char* dir) {
+    const char* key = test_main_cache_key(c);
+    if (!key || strcmp(key, test_saved_cache_key) == 0) return "main.ar's cache key didn't change";
+    return NULL;
+}
+
+static const char* test_cache_only_main_checked(CompileCtx* c, const char* dir) {
+    if (c->body_queries != 1 || c->body_query_hits == 0) {
+        return format_string(
+            "Expected only main's body to be checked, got %lu checked and %lu reused",
+            c->body_queries,
+            c->body_query_hits);
+    }
+    return NULL;
+}
+
+// Round trips through every supported radix, on inline, heap and
+// divide-and-conquer sized values.
+static void test_bigint_radix_round_trips() {
+    total_tests++;
+    fprintf(stderr, "Testing \"bigint radix round trips\" (%d)... ", __LINE__);
+
+    bool error = false;
+    u64 seed = 2463534242ull;
+    usize sizes[] = { 0, 1, 2, 3, 17, 60, 130 };
+    u64 bases[] = { 2, 8, 10, 16 };
+    for (usize s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+        bigint a = bigint_new();
+        for (usize i = 0; i < sizes[s]; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            // Long runs of zero and all-one words stress the chunk
+            // padding.
+            bigint word = bigint_new_u64(i % 5 == 1 ? 0 : i % 5 == 3 ? UINT64_MAX : seed);
+            bigint_shln(&a, 64);
+            bigint_add(&a, &word);
+            bigint_free(&word);
+        }
+        if (s % 2 == 1) bigint_neg(&a);
+
+        for (usize b = 0; b < sizeof(bases)/sizeof(bases[0]); b++) {
+            char* str = bigint_tostring_radix(&a, bases[b]);
+            bool neg = str[0] == '-';
+            bigint c = bigint_from_digits(str + neg, strlen(str + neg), bases[b]);
+            c.neg = neg;
+            if (bigint_cmp(&a, &c) != 0) {
+                if (!error) print_fail_text();
+                error = true;
+                fprintf(
+                    stderr,
+                    "\n  >> %lu words in base %lu came back as %s",
+                    sizes[s],
+                    bases[b],
+                    bigint_tostring_radix(&c, bases[b]));
+            }
+            bigint_free(&c);
+            buffree(str);
+        }
+        bigint_free(&a);
+    }
+
+    if (error) {
+        g_error = true;
+    } else {
+        passed_tests++;
+        fprintf(stderr, "%sok%s", g_green_color, g_reset_color);
+    }
+    fprintf(stderr, "\n");
+}
+
+#ifdef TEST_BENCH
+static double bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void bench_report(const char* name, double start, usize iters) {
+    double ms = (bench_now() - start) / (double)iters;
+    fprintf(stderr, "Bench \"%s\"... %.3f ms/iter\n", name, ms);
+}
+
+// Builds a `digits` long decimal the way the parser builds literals.
+static bigint bench_bigint_decimal(usize digits) {
+    char* str = NULL;
+    for (usize i = 0; i < digits; i++) {
+        bufpush(str, '0' + (char)((i*7 + 3) % 10));
+    }
+    bigint val = bigint_from_digits(str, digits, 10);
+    buffree(str);
+    return val;
+}
+
+static void bench_bigint() {
+    double start = bench_now();
+    bigint a = bench_bigint_decimal(20000);
+    bench_report("bigint parse 20000 digits", start, 1);
+
+    bigint b = bench_bigint_decimal(12000);
+    bigint prod = bigint_new();
+    start = bench_now();
+    for (usize i = 0; i < 20; i++) {
+        bigint_copy(&prod, &a);
+        bigint_mul(&prod, &b);
+    }
+    bench_report("bigint mul 20000x12000 digits", start, 20);
+
+    bigint quo = bigint_new();
+    bigint rem = bigint_new();
+    start = bench_now();
+    for (usize i = 0; i < 20; i++) {
+        bigint_div_mod(&prod, &b, &quo, &rem);
+    }
+    bench_report("bigint divmod 32000/12000 digits", start, 20);
+    assert(bigint_cmp(&quo, &a) == 0 && rem.len == 0);
+
+    bigint small = bench_bigint_decimal(19);
+    start = bench_now();
+    for (usize i = 0; i < 20; i++) {
+        bigint_div_mod(&prod, &small, &quo, &rem);
+    }
+    bench_report("bigint divmod 32000/19 digits", start, 20);
+
+    start = bench_now();
+    char* str = bigint_tostring(&prod);
+    bench_report("bigint tostring 32000 digits", start, 1);
+    bigint back = bigint_from_digits(str, strlen(str), 10);
+    assert(bigint_cmp(&back, &prod) == 0);
+    bigint_free(&back);
+    buffree(str);
+
+    bigint_free(&a);
+    bigint_free(&b);
+    bigint_free(&prod);
+    bigint_free(&quo);
+    bigint_free(&rem);
+    bigint_free(&small);
+}
+
+static void bench_comptime_constants() {
+    char* src = NULL;
+    bufstrexpandpush(src, "imm C0: u64 = 18446744073709551615;\n");
+    for (usize i = 1; i < 2000; i++) {
+        char line[256];
+        snprintf(
+            line,
+            sizeof(line),
+            "imm C%lu: u64 = (C%lu / 3 * 2 + 18446744073709551615 / 7) %% 9223372036854775807 + %lu;\n",
+            i,
+            i-1,
+            i);
+        bufstrexpandpush(src, line);
+    }
+    bufstrexpandpush(src, "fn main() void {}\n");
+    bufpush(src, '\0');
+
+    Srcfile srcfile = (Srcfile){
+        .handle = (File){
+            .path = "<bench>",
+            .abs_path = "<bench>",
+            .contents = src,
+            .len = strlen(src),
+        },
+        .tokens = NULL,
+        .astnodes = NULL,
+    };
+    CompileCtx ctx = compile_new_context(NULL, NULL, false);
+    ctx.print_msg_to_stderr = true;
+    ctx.mod_tys = NULL;
+    bufpush(ctx.mod_tys, typespec_module_new(&srcfile));
+    read_srcfile("core", "core", span_none(), &ctx);
+
+    double start = bench_now();
+    compile(&ctx);
+    bench_report("compile 2000 chained comptime constants", start, 1);
+    assert(buflen(ctx.msgs) == 0);
+    buffree(src);
+}
+#endif
+
 int main() {
     init_global_compiler_state();
     init_bigint();
 
+    test_bigint();
+    test_bigint_radix_round_trips();
+
     test_invalid_one_errspan(
         "unterminated string literal error",
         "\"hello\n",
@@ -720,6 +1255,60 @@ int main() {
     //    1,
     //    28);
 
+    test_invalid_one_errspan(
+        "sized integer overflow",
+        "fn main() void { imm x = (200 as u8) + 100; }\n",
+        "integer overflow",
+        1,
+        27);
+
+    test_invalid_one_errspan(
+        "constant index out of bounds",
+        "fn main() void { imm a: [2]u8 = [1, 2]; imm x = a[2]; }\n",
+        "index `2` is out of bounds for type `[2]u8`",
+        1,
+        51);
+
+    test_invalid_one_errspan(
+        "runtime global initializer",
+        "fn f() u32 { return 1; }\n"
+        "imm G: u32 = 1 + f();\n",
+        "not a compile-time known value",
+        2,
+        18);
+
+    test_invalid_one_errspan(
+        "missing field in aggregate literal",
+        "struct S { a: u8, b: u8, }\n"
+        "fn main() void { imm s = S{ .a = 1 }; }\n",
+        "missing field `b` in literal",
+        2,
+        26);
+
+    test_invalid_one_errspan(
+        "cyclic global dependency",
+        "imm A: u32 = B;\n"
+        "imm B: u32 = A;\n",
+        "`A` depends on itself",
+        2,
+        14);
+
+    test_invalid_one_errspan(
+        "field not found in offsetOf",
+        "struct S { a: u8, }\n"
+        "imm N = @offsetOf(S, b);\n",
+        "symbol not found in type `S`",
+        2,
+        22);
+
+    test_invalid_one_errspan(
+        "struct size mismatch",
+        "struct S { a: u8, b: u64, }\n"
+        "imm A: [@sizeOf(S)]u8 = [0];\n",
+        "cannot convert to `[16]u8` from `[1]u8`",
+        2,
+        23);
+
     test_valid(
         "function definition",
         "fn main() void {}\n");
@@ -762,6 +1351,705 @@ int main() {
         "integer literal",
         "fn main() void { imm x = 1010101010100; }\n");
 
+    test_valid(
+        "constant folding",
+        "struct Point { x: u32, y: u32, }\n"
+        "imm N: u32 = 4;\n"
+        "imm P = Point{ .x = N * 2, .y = ~(0 as u32) };\n"
+        "fn main() void {\n"
+        "    imm a: [N / 2]u8 = [0, 1];\n"
+        "    imm b: u32 = P.x + a[1];\n"
+        "    if (N > 8) { imm c: u8 = 1; } else { imm d: u8 = 2; }\n"
+        "}\n");
+
+    test_valid(
+        "out-of-order declarations",
+        "imm P = Point{ .x = N, .y = 2 };\n"
+        "imm N: u32 = M + 1;\n"
+        "fn f() u32 { return P.x + N; }\n"
+        "struct Point { x: u32, y: u32, }\n"
+        "imm M: u32 = 4;\n"
+        "fn main() void {}\n");
+
+    test_ir(
+        "layout directives",
+        "struct Inner { a: u8, b: u64, }\n"
+        "struct Outer { x: u16, i: Inner, arr: [3]u32, }\n"
+        "packed struct P { a: u8, b: u32, }\n"
+        "imm OUTER_SIZE: u64 = @sizeOf(Outer);\n"
+        "imm OUTER_ALIGN: u64 = @alignOf(Outer);\n"
+        "imm OUTER_I: u64 = @offsetOf(Outer, i);\n"
+        "imm OUTER_ARR: u64 = @offsetOf(Outer, arr);\n"
+        "imm INNER_ARRAY_SIZE: u64 = @sizeOf([2]Inner);\n"
+        "imm P_SIZE: u64 = @sizeOf(P);\n"
+        "imm P_ALIGN: u64 = @alignOf(P);\n"
+        "imm P_B: u64 = @offsetOf(P, b);\n"
+        "fn main() void {\n"
+        "    mut a: [@sizeOf(Outer)]u8;\n"
+        "    mut b: [@offsetOf(Outer, arr)]u8;\n"
+        "    mut c: [@sizeOf(P) + @alignOf(Inner)]u8;\n"
+        "}\n",
+        8,
+        ((const char*[8]){
+            "@_Z0OUTER_SIZE = internal constant i64 40",
+            "@_Z0OUTER_ALIGN = internal constant i64 8",
+            "@_Z0OUTER_I = internal constant i64 8",
+            "@_Z0OUTER_ARR = internal constant i64 24",
+            "@_Z0INNER_ARRAY_SIZE = internal constant i64 32",
+            "@_Z0P_SIZE = internal constant i64 5",
+            "@_Z0P_ALIGN = internal constant i64 1",
+            "@_Z0P_B = internal constant i64 1",
+        })
+    );
+
+    test_ir(
+        "sizes of aggregates over 4 GiB",
+        "fn first(a: *imm [4294967297]u8) u8 { return a[0]; }\n"
+        "fn main() void {}\n",
+        1,
+        ((const char*[1]){
+            "@_Z0first(ptr nonnull readonly dereferenceable(4294967297) %a)",
+        })
+    );
+
+    test_ir(
+        "imm pointer param attributes",
+        "struct Point { x: u64, y: u64, }\n"
+        "fn sum(p: *imm Point) u64 { return p.x + p.y; }\n"
+        "fn main() void { imm p = Point{ .x = 1, .y = 2 }; imm s = sum(&p); }\n",
+        2,
+        ((const char*[2]){
+            "@_Z0sum(ptr nonnull readonly dereferenceable(16) %p)",
+            "attributes #0 = { nounwind",
+        })
+    );
+
+    test_ir(
+        "by-ref return attributes",
+        "struct Big { a: [4]u64, }\n"
+        "fn make() Big { mut b: Big; return b; }\n"
+        "fn main() void { imm b = make(); }\n",
+        2,
+        ((const char*[2]){
+            "@_Z0make(ptr noalias sret(%_Z0Big) %out)",
+            "call fastcc void @_Z0make(ptr sret(%_Z0Big)",
+        })
+    );
+
+    test_ir(
+        "noreturn attribute",
+        "extern fn abort() noreturn;\n"
+        "fn main() void { abort(); }\n",
+        2,
+        ((const char*[2]){
+            "declare void @abort() #",
+            "= { noreturn nounwind }",
+        })
+    );
+
+    // 100000 iterations of 512-byte temporaries would overflow the
+    // stack if they were allocated in the loop's body.
+    test_build(
+        "temporaries in a loop use entry block slots",
+        .files = ((TestFile[1]){
+            { "main.ar",
+              "import \"core\";\n"
+              "struct Big { a: [64]u64, }\n"
+              "fn make(n: u64) Big { mut b: Big; b.a[0] = n; b.a[1] = 1; return b; }\n"
+              "fn main() void {\n"
+              "    mut i: u64 = 0;\n"
+              "    mut sum: u64 = 0;\n"
+              "    while (i < 100000) {\n"
+              "        imm b = make(i);\n"
+              "        sum = sum + b.a[0] - i + make(i).a[1];\n"
+              "        i = i + 1;\n"
+              "    }\n"
+              "    if (sum == 100000) {\n"
+              "        core.exit(3);\n"
+              "    }\n"
+              "}\n" },
+        }),
+        .num_files = 1,
+        .link = true,
+        .exit_code = 3,
+    );
+
+    test_ir(
+        "by-ref results are built in their destination",
+        "struct Big { a: [4]u64, }\n"
+        "fn make(n: u64) Big { mut r: Big; r.a[0] = n; return r; }\n"
+        "fn wrap(n: u64) Big { return make(n); }\n"
+        "fn main() void {\n"
+        "    mut b = wrap(1);\n"
+        "    b = make(b.a[0]);\n"
+        "}\n",
+        5,
+        ((const char*[5]){
+            "call fastcc void @_Z0wrap(i64 1, ptr sret(%_Z0Big) %b)",
+            "call fastcc void @_Z0make(i64 %n, ptr sret(%_Z0Big) %out)",
+            "call fastcc void @_Z0make(i64 %2, ptr sret(%_Z0Big) %b)",
+            "!%r = alloca",
+            "!%tmp = alloca",
+        })
+    );
+
+    test_ir(
+        "lifetime markers for block-scoped locals",
+        "extern fn fill(buf: *[64]u8) void;\n"
+        "fn main() void {\n"
+        "    { mut a: [64]u8; fill(&a); }\n"
+        "    { mut b: [64]u8; fill(&b); }\n"
+        "}\n",
+        4,
+        ((const char*[4]){
+            "call void @llvm.lifetime.start.p0(i64 64, ptr %a)",
+            "call void @llvm.lifetime.end.p0(i64 64, ptr %a)",
+            "call void @llvm.lifetime.start.p0(i64 64, ptr %b)",
+            "call void @llvm.lifetime.end.p0(i64 64, ptr %b)",
+        })
+    );
+
+    test_ir(
+        "constant literals and aggregate copies",
+        "struct V { x: u64, y: u64, }\n"
+        "fn main() void {\n"
+        "    imm t: [4]u64 = [1 as u64, 2, 3, 4];\n"
+        "    mut a = V{ .x = 1, .y = 2 };\n"
+        "    mut b = a;\n"
+        "    a = b;\n"
+        "}\n",
+        6,
+        ((const char*[6]){
+            "private unnamed_addr constant [4 x i64] [i64 1, i64 2, i64 3, i64 4]",
+            "call void @llvm.memcpy.p0.p0.i64(ptr align 8 %t, ptr align 8 @",
+            "call void @llvm.memcpy.p0.p0.i64(ptr align 8 %a, ptr align 8 @",
+            "call void @llvm.memcpy.p0.p0.i64(ptr align 8 %b, ptr align 8 %a, i64 16",
+            "call void @llvm.memmove.p0.p0.i64(ptr align 8 %a, ptr align 8 %b, i64 16",
+            "!insertvalue",
+        })
+    );
+
+    test_ir(
+        "aggregate literals built in place",
+        "struct V { x: u64, y: u64, }\n"
+        "struct B { zero: V, v: V, }\n"
+        "extern fn id(n: u64) u64;\n"
+        "fn main() void {\n"
+        "    mut b = B{ .zero = V{ .x = 0, .y = 0 }, .v = V{ .x = id(1), .y = 2 } };\n"
+        "}\n",
+        4,
+        ((const char*[4]){
+            "call void @llvm.memset.p0.i64(ptr align 8 %1, i8 0, i64 16",
+            "store i64 %0, ptr %3",
+            "store i64 2, ptr %4",
+            "!insertvalue",
+        })
+    );
+
+    test_build(
+        "aggregate copied into a literal before later elements run",
+        .files = ((TestFile[1]){
+            { "main.ar",
+              "import \"core\";\n"
+              "struct A { v: [4]u64, }\n"
+              "struct S { a: A, n: u64, }\n"
+              "fn bump(p: *A) u64 { p.v[0] = 99; return 7; }\n"
+              "fn main() void {\n"
+              "    mut a: A;\n"
+              "    a.v[0] = 1;\n"
+              "    imm s = S{ .a = a, .n = bump(&a) };\n"
+              "    core.exit((s.a.v[0] + s.n) as i8);\n"
+              "}\n" },
+        }),
+        .num_files = 1,
+        .link = true,
+        .exit_code = 8,
+    );
+
+    test_ir(
+        "pruned if keeps its branch's type",
+        "extern fn w(s: []imm u8) void;\n"
+        "fn main() void {\n"
+        "    w(if (true) \"x\" else \"o\");\n"
+        "}\n",
+        1,
+        ((const char*[1]){
+            "call void @w({ ptr, i64 } { ptr @0, i64 1 })",
+        })
+    );
+
+    test_build(
+        "if-expression string passed to a slice in another module",
+        .files = ((TestFile[2]){
+            { "main.ar",
+              "import \"text.ar\";\n"
+              "fn main() void {\n"
+              "    mut xturn = true;\n"
+              "    text.exit_len(if (xturn) \"x\" else \"oo\");\n"
+              "}\n" },
+            { "text.ar",
+              "import \"core\";\n"
+              "fn exit_len(s: []imm u8) void {\n"
+              "    core.exit(s.len as i8);\n"
+              "}\n" },
+        }),
+        .num_files = 2,
+        .link = true,
+        .exit_code = 1,
+    );
+
+    test_build(
+        "break values of nested loops",
+        .files = ((TestFile[1]){
+            { "main.ar",
+              "import \"core\";\n"
+              "fn find(n: u8) u8 {\n"
+              "    imm r = while (true) {\n"
+              "        mut j: u8 = 0;\n"
+              "        imm inner = while (j < 10) {\n"
+              "            if (j == n) break j + 100;\n"
+              "            j = j + 1;\n"
+              "        } else 0;\n"
+              "        if (inner != 0) break if (inner > 101) inner else 7;\n"
+              "        break 3;\n"
+              "    } else 9;\n"
+              "    return r;\n"
+              "}\n"
+              "fn main() void {\n"
+              "    core.exit((find(2) + find(1) + find(50)) as i8);\n"
+              "}\n" },
+        }),
+        .num_files = 1,
+        .link = true,
+        .exit_code = 112,
+    );
+
+    // An importer inlines the folded value of an imported constant,
+    // so changing it must change the importer's cache key.
+    const char* xdg_cache_home = getenv("XDG_CACHE_HOME");
+    char* cache_home = test_make_dir();
+    setenv("XDG_CACHE_HOME", cache_home, 1);
+    TestFile cache_files[2] = {
+        { "main.ar",
+          "import \"core\";\n"
+          "import \"dep.ar\";\n"
+          "fn main() void {\n"
+          "    core.exit(dep.K as i8);\n"
+          "}\n" },
+        { "dep.ar", "imm K: u32 = 5;\n" },
+    };
+    test_build(
+        "cached build",
+        .files = cache_files,
+        .num_files = 2,
+        .use_cache = true,
+        .link = true,
+        .exit_code = 5,
+        .check = test_save_cache_key,
+    );
+    test_build(
+        "unchanged cached build only hits",
+        .files = cache_files,
+        .num_files = 2,
+        .use_cache = true,
+        .link = true,
+        .exit_code = 5,
+        .check = test_cache_all_hits,
+    );
+    cache_files[1].contents = "imm K: u32 = 6;\n";
+    test_build(
+        "changing an imported constant changes the importer's cache key",
+        .files = cache_files,
+        .num_files = 2,
+        .use_cache = true,
+        .link = true,
+        .exit_code = 6,
+        .check = test_cache_key_changed,
+    );
+    cache_files[0].contents =
+        "import \"core\";\n"
+        "import \"dep.ar\";\n"
+        "fn main() void {\n"
+        "    core.exit((dep.K + 1) as i8);\n"
+        "}\n";
+    test_build(
+        "editing a function only rechecks its own module",
+        .files = cache_files,
+        .num_files = 2,
+        .use_cache = true,
+        .link = true,
+        .exit_code = 7,
+        .check = test_cache_only_main_checked,
+    );
+    if (xdg_cache_home) setenv("XDG_CACHE_HOME", xdg_cache_home, 1);
+    else unsetenv("XDG_CACHE_HOME");
+    test_remove_dir(cache_home);
+
+    test_lint(
+        "perf warnings",
+        "import \"core\";\n"
+        "struct Big { a: u64, b: u64, c: u64, d: u64, e: u64 }\n"
+        "struct Padded { a: u8, b: u64, c: u8 }\n"
+        "struct HasArray { a: [8]u64 }\n"
+        "fn take(b: Big) Big { return b; }\n"
+        "fn take_array(a: HasArray) HasArray { return a; }\n"
+        "fn count(n: u64) void {\n"
+        "    mut i: u64 = 0;\n"
+        "    mut c: u8 = 65;\n"
+        "    while (i < n * 2) {\n"
+        "        core.write(&c as [*]imm u8, 1);\n"
+        "        i = i + 1;\n"
+        "    }\n"
+        "}\n"
+        "fn main() void {}\n",
+        7,
+        ((TestMsgSpec[7]){
+            {
+                .kind = MSG_WARNING,
+                .msg = "struct `Padded` wastes 14 of its 24 bytes on padding",
+                .srcloc = { .srcloc = { .line = 3, .col = 8 }, .exists = true },
+            },
+            {
+                .kind = MSG_WARNING,
+                .msg = "parameter of type `Big` is copied on every call (40 bytes)",
+                .srcloc = { .srcloc = { .line = 5, .col = 9 }, .exists = true },
+            },
+            {
+                .kind = MSG_WARNING,
+                .msg = "return value of type `Big` is copied on every call (40 bytes)",
+                .srcloc = { .srcloc = { .line = 5, .col = 17 }, .exists = true },
+            },
+            {
+                .kind = MSG_WARNING,
+                .msg = "parameter of type `HasArray` is copied on every call (64 bytes)",
+                .srcloc = { .srcloc = { .line = 6, .col = 15 }, .exists = true },
+            },
+            {
+                .kind = MSG_WARNING,
+                .msg = "return value of type `HasArray` is copied on every call (64 bytes)",
+                .srcloc = { .srcloc = { .line = 6, .col = 28 }, .exists = true },
+            },
+            {
+                .kind = MSG_WARNING,
+                .msg = "loop condition recomputes invariant `n * 2` on every iteration (8-byte value)",
+                .srcloc = { .srcloc = { .line = 10, .col = 16 }, .exists = true },
+            },
+            {
+                .kind = MSG_WARNING,
+                .msg = "call in loop makes a syscall for every byte (1 byte per syscall)",
+                .srcloc = { .srcloc = { .line = 11, .col = 9 }, .exists = true },
+            },
+        })
+    );
+
+    test_lint(
+        "exit in a loop isn't a per-byte syscall",
+        "import \"core\";\n"
+        "fn main() void {\n"
+        "    mut i: u64 = 0;\n"
+        "    while (i < 10) {\n"
+        "        if (i == 5) core.exit(1);\n"
+        "        i = i + 1;\n"
+        "    }\n"
+        "}\n",
+        0,
+        NULL
+    );
+
+    TestFile add_files[1] = {
+        { "main.ar",
+          "import \"core\";\n"
+          "fn add(a: u64, b: u64) u64 { return a + b; }\n"
+          "fn main() void {\n"
+          "    core.exit(add(3, 4) as i8);\n"
+          "}\n" },
+    };
+    test_build(
+        "-O0 keeps calls",
+        .files = add_files,
+        .num_files = 1,
+        .opt_level = OPT_LEVEL_O0,
+        .link = true,
+        .exit_code = 7,
+        .num_ir_patterns = 2,
+        .ir_patterns = ((const char*[2]){
+            "call fastcc i64 @_Z0add(i64 3, i64 4)",
+            "= !{!\"aria -O0\"}",
+        }),
+    );
+    test_build(
+        "-O2 inlines and records the level",
+        .files = add_files,
+        .num_files = 1,
+        .opt_level = OPT_LEVEL_O2,
+        .link = true,
+        .exit_code = 7,
+        .num_ir_patterns = 2,
+        .ir_patterns = ((const char*[2]){
+            "!@_Z0add",
+            "= !{!\"aria -O2\"}",
+        }),
+        .num_asm_patterns = 1,
+        .asm_patterns = ((const char*[1]){
+            ".ident\t\"aria -O2\"",
+        }),
+    );
+    test_build(
+        "-Os is recorded",
+        .files = add_files,
+        .num_files = 1,
+        .opt_level = OPT_LEVEL_Os,
+        .num_ir_patterns = 2,
+        .ir_patterns = ((const char*[2]){
+            "!@_Z0add",
+            "= !{!\"aria -Os\"}",
+        }),
+    );
+
+    test_build(
+        "--mcpu and --mattr",
+        .files = add_files,
+        .num_files = 1,
+        .cpu = "haswell",
+        .features = "-avx2,+bmi2",
+        .num_ir_patterns = 1,
+        .ir_patterns = ((const char*[1]){
+            "\"target-cpu\"=\"haswell\" \"target-features\"=\"-avx2,+bmi2\"",
+        }),
+    );
+    test_build(
+        "--mcpu=native runs on the host",
+        .files = add_files,
+        .num_files = 1,
+        .cpu = "native",
+        .link = true,
+        .exit_code = 7,
+        .num_ir_patterns = 2,
+        .ir_patterns = ((const char*[2]){
+            "\"target-cpu\"=",
+            "!\"target-cpu\"=\"native\"",
+        }),
+    );
+
+    test_build(
+        "every emit kind at once",
+        .files = add_files,
+        .num_files = 1,
+        .emit_obj = true,
+        .emit_bc = true,
+        .link = true,
+        .exit_code = 7,
+        .num_ir_patterns = 1,
+        .ir_patterns = ((const char*[1]){
+            "define internal fastcc i64 @_Z0add(",
+        }),
+        .num_asm_patterns = 1,
+        .asm_patterns = ((const char*[1]){
+            "_Z0add:",
+        }),
+        .check = test_check_all_outputs,
+    );
+
+    const char* tmpdir_env = getenv("TMPDIR");
+    test_tmpdir = test_make_dir();
+    setenv("TMPDIR", test_tmpdir, 1);
+    test_build(
+        "linking several modules removes the temporary objects",
+        .files = ((TestFile[2]){
+            { "main.ar",
+              "import \"core\";\n"
+              "import \"math.ar\";\n"
+              "fn main() void {\n"
+              "    core.exit(math.square(5) as i8);\n"
+              "}\n" },
+            { "math.ar",
+              "fn square(x: u64) u64 { return x * x; }\n" },
+        }),
+        .num_files = 2,
+        .link = true,
+        .exit_code = 25,
+        .check = test_tmpdir_is_empty,
+    );
+    // Objects go to a directory of their own, so files of the same
+    // name from another build are left alone.
+    test_write_file(test_tmpdir, "mod.o", "sentinel");
+    test_build(
+        "temporary objects don't clobber other files",
+        .files = add_files,
+        .num_files = 1,
+        .codegen_threads = 2,
+        .link = true,
+        .exit_code = 7,
+        .check = test_tmpdir_kept_sentinel,
+    );
+    if (tmpdir_env) setenv("TMPDIR", tmpdir_env, 1);
+    else unsetenv("TMPDIR");
+    test_remove_dir(test_tmpdir);
+
+    test_build(
+        "start code is module inline asm",
+        .files = add_files,
+        .num_files = 1,
+        .num_ir_patterns = 4,
+        .ir_patterns = ((const char*[4]){
+            "module asm \"_start:\"",
+            "module asm \"    callq ariamain\"",
+            "module asm \"_syscall:\"",
+            "module asm \"    .weak memcpy\"",
+        }),
+        .num_asm_patterns = 2,
+        .asm_patterns = ((const char*[2]){
+            "_start:",
+            "_syscall:",
+        }),
+    );
+    test_build(
+        "naked builds have no start code",
+        .files = ((TestFile[1]){
+            { "main.ar",
+              "export fn add(a: u64, b: u64) u64 { return a + b; }\n"
+              "fn main() void {}\n" },
+        }),
+        .num_files = 1,
+        .naked = true,
+        .emit_obj = true,
+        .num_ir_patterns = 2,
+        .ir_patterns = ((const char*[2]){
+            "define i64 @add(",
+            "!module asm",
+        }),
+    );
+
+    test_build(
+        "backend split across codegen threads",
+        .files = ((TestFile[1]){
+            { "main.ar",
+              "import \"core\";\n"
+              "mut counter: u64 = 1;\n"
+              "fn a(x: u64) u64 { counter = counter + 1; return x + counter; }\n"
+              "fn b(x: u64) u64 { return a(x) * 2; }\n"
+              "fn c(x: u64) u64 { return b(x) + a(x); }\n"
+              "fn d(x: u64) u64 { return c(x) - 1; }\n"
+              "fn main() void {\n"
+              "    core.exit(d(3) as i8);\n"
+              "}\n" },
+        }),
+        .num_files = 1,
+        .codegen_threads = 4,
+        .link = true,
+        .exit_code = 15,
+        .check = test_split_into_parts,
+    );
+
+    TestFile lto_files[2] = {
+        { "main.ar",
+          "import \"core\";\n"
+          "extern fn add3(x: i64) i64;\n"
+          "fn compute(x: i64) i64 { return add3(x) + 1; }\n"
+          "fn main() void { core.exit(compute(4) as i8); }\n" },
+        { "helper.ll",
+          "@bias = internal global i64 2\n"
+          "define internal i64 @twice(i64 %x) {\n"
+          "  %r = mul i64 %x, 2\n"
+          "  ret i64 %r\n"
+          "}\n"
+          "define i64 @add3(i64 %x) {\n"
+          "  %t = call i64 @twice(i64 %x)\n"
+          "  %b = load i64, ptr @bias\n"
+          "  %s = add i64 %t, %b\n"
+          "  ret i64 %s\n"
+          "}\n" },
+    };
+    test_build(
+        "full LTO with an IR input",
+        .files = lto_files,
+        .num_files = 2,
+        .opt_level = OPT_LEVEL_O2,
+        .lto_mode = LTO_FULL,
+        .link = true,
+        .exit_code = 11,
+        .num_ir_patterns = 3,
+        .ir_patterns = ((const char*[3]){
+            "!call i64 @add3",
+            "!@twice",
+            "!@bias",
+        }),
+    );
+    test_build(
+        "thin LTO with an IR input",
+        .files = lto_files,
+        .num_files = 2,
+        .opt_level = OPT_LEVEL_O2,
+        .lto_mode = LTO_THIN,
+        .link = true,
+        .exit_code = 11,
+        .num_ir_patterns = 2,
+        .ir_patterns = ((const char*[2]){
+            "@bias.aria.ir0 = external hidden",
+            "!call i64 @add3",
+        }),
+    );
+
+    test_build(
+        "aria run returns the program's exit status",
+        .files = add_files,
+        .num_files = 1,
+        .run = true,
+        .exit_code = 7,
+    );
+    test_build(
+        "aria run with an IR input",
+        .files = lto_files,
+        .num_files = 2,
+        .run = true,
+        .exit_code = 11,
+    );
+    test_build(
+        "aria run of a program that returns from main",
+        .files = ((TestFile[1]){
+            { "main.ar", "fn main() void {}\n" },
+        }),
+        .num_files = 1,
+        .run = true,
+        .exit_code = 0,
+    );
+
+    test_build(
+        "linkage of exported and module-local symbols",
+        .files = ((TestFile[1]){
+            { "main.ar",
+              "import \"core\";\n"
+              "imm LIMIT: u64 = 4;\n"
+              "mut total: u64 = 0;\n"
+              "fn helper(x: u64) u64 { return x + LIMIT; }\n"
+              "export fn api(x: u64) u64 { return helper(x); }\n"
+              "export fn first(s: []imm u8) u8 { return s[0]; }\n"
+              "fn main() void {\n"
+              "    total = api(1) + first(\"hi\");\n"
+              "    core.exit(total as i8);\n"
+              "}\n" },
+        }),
+        .num_files = 1,
+        .link = true,
+        .exit_code = 109,
+        .num_ir_patterns = 8,
+        .ir_patterns = ((const char*[8]){
+            "@_Z0LIMIT = internal constant i64 4",
+            "@_Z0total = internal global i64 0",
+            "= private unnamed_addr constant [3 x i8] c\"hi\\00\"",
+            "@SYS_WRITE = external externally_initialized constant i16",
+            "define internal fastcc i64 @_Z0helper(",
+            "call fastcc i64 @_Z0helper(",
+            "define i64 @api(",
+            "define i8 @first(",
+        }),
+    );
+
+#ifdef TEST_BENCH
+    bench_bigint();
+    bench_comptime_constants();
+#endif
+
     // REMINDER: At scoped block
     // TODO: add tests for using variable/function in itself
     // TODO: add tests for using values as types in variables/functions
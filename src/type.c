@@ -2,10 +2,27 @@
 #include "buf.h"
 #include "ast.h"
 
+TargetLayout target_layout = {
+    .ptr_bytes = 8,
+    .ptr_align = 8,
+    .int_align = { 1, 2, 4, 8 },
+};
+
+void target_layout_init(LLVMTargetDataRef llvmtargetdatalayout) {
+    target_layout.ptr_bytes = LLVMPointerSize(llvmtargetdatalayout);
+    target_layout.ptr_align = LLVMABIAlignmentOfType(
+        llvmtargetdatalayout,
+        LLVMPointerTypeInContext(LLVMGetGlobalContext(), 0));
+    for (usize i = 0; i < 4; i++) {
+        target_layout.int_align[i] = LLVMABIAlignmentOfType(
+            llvmtargetdatalayout,
+            LLVMIntType(8 << i));
+    }
+}
+
 static Typespec* typespec_new(TypespecKind kind) {
     Typespec* ty = alloc_obj(Typespec);
     ty->kind = kind;
-    ty->llvmtype = NULL;
     return ty;
 }
 
@@ -71,6 +88,8 @@ Typespec* typespec_struct_new(struct AstNode* astnode) {
     Typespec* ty = typespec_new(TS_STRUCT);
     ty->agg.ref = astnode;
     ty->agg.pass_by_ref = false;
+    ty->agg.size = 0;
+    ty->agg.align = 1;
     return ty;
 }
 
@@ -263,7 +282,7 @@ bool typespec_is_pass_by_ref(Typespec* ty) {
     return false;
 }
 
-u32 typespec_get_bytes(Typespec* ty) {
+u64 typespec_get_bytes(Typespec* ty) {
     if (ty->kind == TS_TYPE) return typespec_get_bytes(ty->ty);
     switch (ty->kind) {
         case TS_PRIM: {
@@ -281,7 +300,7 @@ u32 typespec_get_bytes(Typespec* ty) {
                 case PRIM_i64:
                     return 8;
                 case PRIM_INTEGER: {
-                    u64 d = ty->prim.integer.d[0];
+                    u64 d = bigint_low_u64(&ty->prim.integer);
                     usize bits = get_bits_for_value(d);
                     if (bits <= 8) bits = 8;
                     else if (bits <= 16) bits = 16;
@@ -299,14 +318,111 @@ u32 typespec_get_bytes(Typespec* ty) {
 
         case TS_PTR:
         case TS_MULTIPTR: {
-            // TODO: make this platform specific
-            return 8;
+            return target_layout.ptr_bytes;
         } break;
     }
+    return typespec_get_size(ty);
+}
+
+static u64 align_up(u64 n, u64 align) {
+    return (n + align - 1) / align * align;
+}
+
+static u32 get_int_align(u32 bytes) {
+    switch (bytes) {
+        case 1: return target_layout.int_align[0];
+        case 2: return target_layout.int_align[1];
+        case 4: return target_layout.int_align[2];
+        case 8: return target_layout.int_align[3];
+    }
     assert(0);
     return 0;
 }
 
+u64 typespec_get_size(Typespec* ty) {
+    switch (ty->kind) {
+        case TS_PRIM:
+        case TS_PTR:
+        case TS_MULTIPTR:
+            return typespec_get_bytes(ty);
+
+        case TS_void:
+        case TS_noreturn:
+            return 0;
+
+        case TS_SLICE: {
+            u64 len_offset = align_up(target_layout.ptr_bytes, get_int_align(8));
+            return align_up(len_offset + 8, typespec_get_align(ty));
+        } break;
+
+        case TS_ARRAY: {
+            return bigint_low_u64(&ty->array.size->prim.integer) * typespec_get_size(ty->array.child);
+        } break;
+
+        case TS_STRUCT: {
+            assert(ty->agg.ref->strct.color == CCBLACK);
+            return ty->agg.size;
+        } break;
+
+        case TS_TYPE:
+            return typespec_get_size(ty->ty);
+    }
+    assert(0);
+    return 0;
+}
+
+u64 typespec_get_align(Typespec* ty) {
+    switch (ty->kind) {
+        case TS_PRIM: {
+            if (ty->prim.kind == PRIM_bool) return 1;
+            return get_int_align(typespec_get_bytes(ty));
+        } break;
+
+        case TS_PTR:
+        case TS_MULTIPTR:
+            return target_layout.ptr_align;
+
+        case TS_void:
+        case TS_noreturn:
+            return 1;
+
+        case TS_SLICE: {
+            u32 len_align = get_int_align(8);
+            return target_layout.ptr_align > len_align ? target_layout.ptr_align : len_align;
+        } break;
+
+        case TS_ARRAY:
+            return typespec_get_align(ty->array.child);
+
+        case TS_STRUCT: {
+            assert(ty->agg.ref->strct.color == CCBLACK);
+            return ty->agg.align;
+        } break;
+
+        case TS_TYPE:
+            return typespec_get_align(ty->ty);
+    }
+    assert(0);
+    return 0;
+}
+
+void typespec_compute_struct_layout(Typespec* ty) {
+    assert(ty->kind == TS_STRUCT);
+    AstNode* astnode = ty->agg.ref;
+    u64 offset = 0;
+    u64 align = 1;
+    bufloop(astnode->strct.fields, i) {
+        AstNode* field = astnode->strct.fields[i];
+        u64 field_align = astnode->strct.packed ? 1 : typespec_get_align(field->typespec);
+        offset = align_up(offset, field_align);
+        field->field.offset = offset;
+        offset += typespec_get_size(field->typespec);
+        if (field_align > align) align = field_align;
+    }
+    ty->agg.size = align_up(offset, align);
+    ty->agg.align = align;
+}
+
 char* typespec_tostring(Typespec* ty) {
     char* buf = NULL;
     bufstrexpandpush(buf, tostring(ty));
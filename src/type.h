@@ -5,6 +5,7 @@
 #include "bigint.h"
 
 #include <llvm-c/Core.h>
+#include <llvm-c/Target.h>
 
 struct AstNode;
 struct Srcfile;
@@ -45,8 +46,6 @@ typedef enum {
 typedef struct Typespec {
     TypespecKind kind;
 
-    LLVMTypeRef llvmtype;
-
     union {
         struct {
             PrimKind kind;
@@ -81,6 +80,9 @@ typedef struct Typespec {
         struct {
             struct AstNode* ref;
             bool pass_by_ref;
+            // Computed along with `pass_by_ref`.
+            u64 size;
+            u64 align;
         } agg;
 
         struct Typespec* ty;
@@ -91,6 +93,19 @@ typedef struct Typespec {
     };
 } Typespec;
 
+// Sizes and alignments of the target, taken
+// from its LLVM data layout.
+typedef struct {
+    u32 ptr_bytes;
+    u32 ptr_align;
+    // Alignment of 1, 2, 4 and 8 byte integers.
+    u32 int_align[4];
+} TargetLayout;
+
+extern TargetLayout target_layout;
+
+void target_layout_init(LLVMTargetDataRef llvmtargetdatalayout);
+
 Typespec* typespec_prim_new(PrimKind kind);
 Typespec* typespec_unsized_integer_new(bigint val);
 Typespec* typespec_void_new();
@@ -114,7 +129,14 @@ bool typespec_is_signed(Typespec* ty);
 bool typespec_is_arrptr(Typespec* ty);
 // Only use after semantic analysis.
 bool typespec_is_pass_by_ref(Typespec* ty);
-u32 typespec_get_bytes(Typespec* ty);
+u64 typespec_get_bytes(Typespec* ty);
+// Struct layouts must be computed before querying
+// the size or alignment of types containing them.
+u64 typespec_get_size(Typespec* ty);
+u64 typespec_get_align(Typespec* ty);
+// Assigns field offsets and computes the size and alignment
+// of a struct. Nested structs must already be laid out.
+void typespec_compute_struct_layout(Typespec* ty);
 char* typespec_tostring(Typespec* ty);
 
 char* typespec_integer_get_min_value(Typespec* ty);